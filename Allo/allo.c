@@ -0,0 +1,146 @@
+#include "allo.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+#include "object.h"
+#include "program.h"
+#include "virtual_machine.h"
+
+// A VM of the host's, swapped into the calling thread's slot for each call.
+struct AlloVM {
+    VM vm;
+};
+
+// The AlloVM itself comes from the host's allocator too, but isn't counted
+// against the limit.
+static AlloVM* allocate_host(const AlloAllocator* allocator) {
+    if (allocator->realloc == NULL) return malloc(sizeof(AlloVM));
+    return allocator->alloc(allocator->user, sizeof(AlloVM));
+}
+
+static void free_host(AlloVM* host) {
+    Allocator allocator = host->vm.allocator;
+    if (allocator.realloc == NULL) {
+        free(host);
+    } else {
+        allocator.free(allocator.user, host, sizeof(AlloVM));
+    }
+}
+
+static AlloResult to_result(InterpretResult result) {
+    switch (result) {
+        case INTERPRET_OK: return ALLO_OK;
+        case INTERPRET_COMPILE_ERROR: return ALLO_COMPILE_ERROR;
+        case INTERPRET_TIMEOUT: return ALLO_TIMEOUT;
+        default: return ALLO_RUNTIME_ERROR;
+    }
+}
+
+static void init_vm_body(void* context) {
+    (void)context;
+    init_vm();
+}
+
+AlloVM* allo_new_vm(const AlloConfig* config) {
+    AlloVM* host = allocate_host(&config->allocator);
+    if (host == NULL) return NULL;
+
+    memset(&host->vm, 0, sizeof(VM));
+    host->vm.allocator = config->allocator;
+    host->vm.memoryLimit = config->memoryLimit;
+
+    swap_vm(&host->vm);
+    bool initialized = run_protected(init_vm_body, NULL);
+    if (!initialized) {
+        free_vm();
+    } else if (config->output != NULL) {
+        set_output_file(config->output);
+    }
+    swap_vm(&host->vm);
+
+    if (!initialized) {
+        free_host(host);
+        return NULL;
+    }
+    return host;
+}
+
+void allo_free_vm(AlloVM* host) {
+    swap_vm(&host->vm);
+    free_vm();
+    swap_vm(&host->vm);
+    free_host(host);
+}
+
+AlloResult allo_run(AlloVM* host, const char* source) {
+    swap_vm(&host->vm);
+    InterpretResult result = interpret_code(source);
+    swap_vm(&host->vm);
+    return to_result(result);
+}
+
+AlloProgram* allo_compile(AlloVM* host, const char* source) {
+    swap_vm(&host->vm);
+    Program* program = compile_program(source);
+    swap_vm(&host->vm);
+    return program;
+}
+
+void allo_release_program(AlloProgram* program) {
+    release_program(program);
+}
+
+AlloResult allo_run_program(AlloVM* host, AlloProgram* program) {
+    swap_vm(&host->vm);
+    InterpretResult result = interpret_program(program);
+    swap_vm(&host->vm);
+    return to_result(result);
+}
+
+typedef struct {
+    const char* name;
+    const char* string;     // NULL for a number
+    double number;
+} GlobalDefinition;
+
+static void define_body(void* context) {
+    GlobalDefinition* definition = context;
+    Value value = definition->string == NULL
+        ? NUMBER_VAL(definition->number)
+        : OBJ_VAL(copy_string(definition->string, (int)strlen(definition->string)));
+    define_global(definition->name, value);
+}
+
+static bool define(AlloVM* host, GlobalDefinition* definition) {
+    swap_vm(&host->vm);
+    bool defined = run_protected(define_body, definition);
+    swap_vm(&host->vm);
+    return defined;
+}
+
+bool allo_define_number(AlloVM* host, const char* name, double value) {
+    return define(host, &(GlobalDefinition){name, NULL, value});
+}
+
+bool allo_define_string(AlloVM* host, const char* name, const char* value) {
+    return define(host, &(GlobalDefinition){name, value, 0});
+}
+
+void allo_reset(AlloVM* host) {
+    swap_vm(&host->vm);
+    reset_vm();
+    swap_vm(&host->vm);
+}
+
+atomic_bool* allo_interrupt_flag(AlloVM* host) {
+    swap_vm(&host->vm);
+    atomic_bool* flag = interrupt_flag();
+    swap_vm(&host->vm);
+    return flag;
+}
+
+size_t allo_memory_used(const AlloVM* host) {
+    return host->vm.memoryUsed;
+}
@@ -0,0 +1,74 @@
+#ifndef allo_h
+#define allo_h
+
+// The embedding API: everything a host needs to run scripts in VMs of its
+// own, each with its own heap and memory limit. Link against allo_runtime.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Where a VM gets its memory from. `alloc` and `realloc` return NULL when
+// they can't; sizes passed to `realloc` and `free` are the block's current
+// size, so an arena needs no headers of its own. Leave all three NULL for
+// the libc heap.
+typedef struct {
+    void* (*alloc)(void* user, size_t size);
+    void* (*realloc)(void* user, void* pointer, size_t oldSize, size_t newSize);
+    void (*free)(void* user, void* pointer, size_t size);
+    void* user;
+} AlloAllocator;
+
+typedef struct {
+    AlloAllocator allocator;
+    // Most bytes the VM may hold at once, 0 for no limit. A run that would
+    // go past it fails with ALLO_RUNTIME_ERROR, as does one the allocator
+    // can't serve, and the VM stays usable.
+    size_t memoryLimit;
+    FILE* output;               // where print writes; NULL for stdout
+} AlloConfig;
+
+typedef enum {
+    ALLO_OK,
+    ALLO_COMPILE_ERROR,
+    ALLO_RUNTIME_ERROR,
+    ALLO_TIMEOUT,               // stopped by allo_interrupt_flag()
+} AlloResult;
+
+typedef struct AlloVM AlloVM;
+// A compiled script, runnable by any number of VMs, also on other threads.
+typedef struct Program AlloProgram;
+
+// Returns NULL when the VM doesn't fit in its own limit or allocator.
+AlloVM* allo_new_vm(const AlloConfig* config);
+void allo_free_vm(AlloVM* vm);
+
+// Compiles and runs `source` once. Globals it defines stay in the VM.
+AlloResult allo_run(AlloVM* vm, const char* source);
+
+// Returns NULL on a compile error. The program's memory comes from the VM's
+// allocator but isn't counted against its limit once compiled, since the
+// program can outlive it; it has to stay valid until the program is released.
+AlloProgram* allo_compile(AlloVM* vm, const char* source);
+void allo_release_program(AlloProgram* program);
+// Running a different program than last time clears the VM's globals.
+AlloResult allo_run_program(AlloVM* vm, AlloProgram* program);
+
+// Define a global for the scripts run next, returning false when there's no
+// memory for it.
+bool allo_define_number(AlloVM* vm, const char* name, double value);
+bool allo_define_string(AlloVM* vm, const char* name, const char* value);
+// Drops the globals and strings earlier runs left behind.
+void allo_reset(AlloVM* vm);
+
+// The VM's interrupt flag. Ask for it between runs, on the thread that runs
+// the VM; runs check it as they go from then on. Setting it, from any thread
+// or a signal handler, stops the VM's run in progress, or its next one, with
+// ALLO_TIMEOUT. The flag is cleared when that run ends, however it ends.
+atomic_bool* allo_interrupt_flag(AlloVM* vm);
+
+// Bytes the VM holds right now, as counted against its limit.
+size_t allo_memory_used(const AlloVM* vm);
+
+#endif //allo_h
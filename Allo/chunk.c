@@ -3,6 +3,162 @@
 
 #include "memory.h"
 
+const int8_t stackEffects[] = {
+    [OP_CONSTANT]       = 1,
+    [OP_NIL]            = 1,
+    [OP_TRUE]           = 1,
+    [OP_FALSE]          = 1,
+
+    [OP_ADD]            = -1,
+    [OP_SUBTRACT]       = -1,
+    [OP_MULTIPLY]       = -1,
+    [OP_DIVIDE]         = -1,
+    [OP_NEGATE]         = 0,
+
+    [OP_EQUAL]          = -1,
+    [OP_NOT_EQUAL]      = -1,
+    [OP_GREATER]        = -1,
+    [OP_GREATER_EQUAL]  = -1,
+    [OP_LESS]           = -1,
+    [OP_LESS_EQUAL]     = -1,
+    [OP_NOT]            = 0,
+
+    [OP_PRINT]          = -1,
+    [OP_POP]            = -1,
+    [OP_DUP]            = 1,
+    [OP_DEFINE_GLOBAL]  = -1,
+    [OP_GET_GLOBAL]     = 1,
+    [OP_SET_GLOBAL]     = 0,
+    [OP_GET_LOCAL]      = 1,
+    [OP_SET_LOCAL]      = 0,
+
+    [OP_NEW_LIST]       = 1,
+    [OP_APPEND]         = -1,
+    [OP_GET_INDEX]      = -1,
+    [OP_SET_INDEX]      = -2,
+    [OP_LEN]            = 0,
+    [OP_SUM]            = 0,
+    [OP_MIN]            = 0,
+    [OP_MAX]            = 0,
+    [OP_DOT]            = -1,
+
+    [OP_NEW_MAP]        = 1,
+    [OP_ADD_ENTRY]      = -2,
+    [OP_DELETE]         = -1,
+    [OP_GET_DEFAULT]    = -2,
+    [OP_SLICE]          = -2,
+    [OP_SPLIT]          = -1,
+    [OP_FIND]           = -1,
+
+    [OP_ADD_NUM]            = -1,
+    [OP_ADD_STRING]         = -1,
+    [OP_ADD_GENERIC]        = -1,
+    [OP_SUBTRACT_NUM]       = -1,
+    [OP_MULTIPLY_NUM]       = -1,
+    [OP_DIVIDE_NUM]         = -1,
+    [OP_NEGATE_NUM]         = 0,
+    [OP_GREATER_NUM]        = -1,
+    [OP_GREATER_EQUAL_NUM]  = -1,
+    [OP_LESS_NUM]           = -1,
+    [OP_LESS_EQUAL_NUM]     = -1,
+
+    [OP_ADD_UNCHECKED]            = -1,
+    [OP_SUBTRACT_UNCHECKED]       = -1,
+    [OP_MULTIPLY_UNCHECKED]       = -1,
+    [OP_DIVIDE_UNCHECKED]         = -1,
+    [OP_NEGATE_UNCHECKED]         = 0,
+    [OP_GREATER_UNCHECKED]        = -1,
+    [OP_GREATER_EQUAL_UNCHECKED]  = -1,
+    [OP_LESS_UNCHECKED]           = -1,
+    [OP_LESS_EQUAL_UNCHECKED]     = -1,
+
+    [OP_YIELD]          = 0,
+    [OP_RETURN]         = 0,
+};
+
+// Only the opcodes listed have an operand; every other entry is 0.
+const uint8_t operandBytes[OPCODE_COUNT] = {
+    [OP_CONSTANT]       = 1,
+    [OP_DEFINE_GLOBAL]  = 1,
+    [OP_GET_GLOBAL]     = 1,
+    [OP_SET_GLOBAL]     = 1,
+    [OP_GET_LOCAL]      = 1,
+    [OP_SET_LOCAL]      = 1,
+    [OP_NEW_LIST]       = 1,
+    [OP_NEW_MAP]        = 1,
+};
+
+const char* const opcodeNames[] = {
+    [OP_CONSTANT]       = "OP_CONSTANT",
+    [OP_NIL]            = "OP_NIL",
+    [OP_TRUE]           = "OP_TRUE",
+    [OP_FALSE]          = "OP_FALSE",
+
+    [OP_ADD]            = "OP_ADD",
+    [OP_SUBTRACT]       = "OP_SUBTRACT",
+    [OP_MULTIPLY]       = "OP_MULTIPLY",
+    [OP_DIVIDE]         = "OP_DIVIDE",
+    [OP_NEGATE]         = "OP_NEGATE",
+
+    [OP_EQUAL]          = "OP_EQUAL",
+    [OP_NOT_EQUAL]      = "OP_NOT_EQUAL",
+    [OP_GREATER]        = "OP_GREATER",
+    [OP_GREATER_EQUAL]  = "OP_GREATER_EQUAL",
+    [OP_LESS]           = "OP_LESS",
+    [OP_LESS_EQUAL]     = "OP_LESS_EQUAL",
+    [OP_NOT]            = "OP_NOT",
+
+    [OP_PRINT]          = "OP_PRINT",
+    [OP_POP]            = "OP_POP",
+    [OP_DUP]            = "OP_DUP",
+    [OP_DEFINE_GLOBAL]  = "OP_DEFINE_GLOBAL",
+    [OP_GET_GLOBAL]     = "OP_GET_GLOBAL",
+    [OP_SET_GLOBAL]     = "OP_SET_GLOBAL",
+    [OP_GET_LOCAL]      = "OP_GET_LOCAL",
+    [OP_SET_LOCAL]      = "OP_SET_LOCAL",
+
+    [OP_NEW_LIST]       = "OP_NEW_LIST",
+    [OP_APPEND]         = "OP_APPEND",
+    [OP_GET_INDEX]      = "OP_GET_INDEX",
+    [OP_SET_INDEX]      = "OP_SET_INDEX",
+    [OP_LEN]            = "OP_LEN",
+    [OP_SUM]            = "OP_SUM",
+    [OP_MIN]            = "OP_MIN",
+    [OP_MAX]            = "OP_MAX",
+    [OP_DOT]            = "OP_DOT",
+    [OP_NEW_MAP]        = "OP_NEW_MAP",
+    [OP_ADD_ENTRY]      = "OP_ADD_ENTRY",
+    [OP_DELETE]         = "OP_DELETE",
+    [OP_GET_DEFAULT]    = "OP_GET_DEFAULT",
+    [OP_SLICE]          = "OP_SLICE",
+    [OP_SPLIT]          = "OP_SPLIT",
+    [OP_FIND]           = "OP_FIND",
+
+    [OP_ADD_NUM]            = "OP_ADD_NUM",
+    [OP_ADD_STRING]         = "OP_ADD_STRING",
+    [OP_ADD_GENERIC]        = "OP_ADD_GENERIC",
+    [OP_SUBTRACT_NUM]       = "OP_SUBTRACT_NUM",
+    [OP_MULTIPLY_NUM]       = "OP_MULTIPLY_NUM",
+    [OP_DIVIDE_NUM]         = "OP_DIVIDE_NUM",
+    [OP_NEGATE_NUM]         = "OP_NEGATE_NUM",
+    [OP_GREATER_NUM]        = "OP_GREATER_NUM",
+    [OP_GREATER_EQUAL_NUM]  = "OP_GREATER_EQUAL_NUM",
+    [OP_LESS_NUM]           = "OP_LESS_NUM",
+    [OP_LESS_EQUAL_NUM]     = "OP_LESS_EQUAL_NUM",
+
+    [OP_ADD_UNCHECKED]            = "OP_ADD_UNCHECKED",
+    [OP_SUBTRACT_UNCHECKED]       = "OP_SUBTRACT_UNCHECKED",
+    [OP_MULTIPLY_UNCHECKED]       = "OP_MULTIPLY_UNCHECKED",
+    [OP_DIVIDE_UNCHECKED]         = "OP_DIVIDE_UNCHECKED",
+    [OP_NEGATE_UNCHECKED]         = "OP_NEGATE_UNCHECKED",
+    [OP_GREATER_UNCHECKED]        = "OP_GREATER_UNCHECKED",
+    [OP_GREATER_EQUAL_UNCHECKED]  = "OP_GREATER_EQUAL_UNCHECKED",
+    [OP_LESS_UNCHECKED]           = "OP_LESS_UNCHECKED",
+    [OP_LESS_EQUAL_UNCHECKED]     = "OP_LESS_EQUAL_UNCHECKED",
+
+    [OP_YIELD]          = "OP_YIELD",
+    [OP_RETURN]         = "OP_RETURN",
+};
 
 void init_chunk(Chunk* chunk) {
     if(chunk == NULL) return;
@@ -11,6 +167,7 @@ void init_chunk(Chunk* chunk) {
     chunk->capacity = 0;
     chunk->code = NULL;
     chunk->lines = NULL;
+    chunk->maxStack = 0;
 
     init_value_array(&chunk->constants);
 
@@ -28,10 +185,13 @@ void free_chunk(Chunk* chunk) {
 
 void write_chunk(Chunk* chunk, uint8_t byte, int line) {
     if (chunk->capacity < chunk->count + 1) {
+        // The capacity is only raised once both arrays have grown, so running
+        // out of memory in between leaves a chunk free_chunk() can free.
         int oldCapacity = chunk->capacity;
-        chunk->capacity = GROW_CAPACITY(oldCapacity);
-        chunk->code = GROW_ARRAY(uint8_t, chunk->code, oldCapacity, chunk->capacity);
-        chunk->lines = GROW_ARRAY(int, chunk->lines, oldCapacity, chunk->capacity);
+        int capacity = GROW_CAPACITY(oldCapacity);
+        chunk->code = GROW_ARRAY(uint8_t, chunk->code, oldCapacity, capacity);
+        chunk->lines = GROW_ARRAY(int, chunk->lines, oldCapacity, capacity);
+        chunk->capacity = capacity;
     }
 
     chunk->lines[chunk->count] = line;
@@ -27,16 +27,80 @@ typedef enum {
 
     OP_PRINT,
     OP_POP,
+    OP_DUP,
     OP_DEFINE_GLOBAL,
     OP_GET_GLOBAL,
     OP_SET_GLOBAL,
     OP_GET_LOCAL,
     OP_SET_LOCAL,
 
+    // Lists. OP_NEW_LIST's operand is how many elements the literal has, to
+    // allocate room for them up front; each element is then added with
+    // OP_APPEND, which leaves the list on the stack. OP_LEN to OP_DOT are the
+    // builtins of the same names.
+    OP_NEW_LIST,
+    OP_APPEND,
+    OP_GET_INDEX,
+    OP_SET_INDEX,
+    OP_LEN,
+    OP_SUM,
+    OP_MIN,
+    OP_MAX,
+    OP_DOT,
+
+    // Maps. OP_NEW_MAP's operand is how many entries the literal has, to size
+    // the table for them up front; each entry is then added with
+    // OP_ADD_ENTRY, which leaves the map on the stack. Indexing shares
+    // OP_GET_INDEX and OP_SET_INDEX with lists, and len() OP_LEN.
+    // OP_DELETE and OP_GET_DEFAULT are the builtins delete() and get().
+    OP_NEW_MAP,
+    OP_ADD_ENTRY,
+    OP_DELETE,
+    OP_GET_DEFAULT,
+
+    // Strings. OP_SLICE takes the string and both bounds, nil for a missing
+    // one; OP_SPLIT and OP_FIND are the builtins split() and find().
+    OP_SLICE,
+    OP_SPLIT,
+    OP_FIND,
+
+    // Written over the generic instructions above by the VM once it has seen
+    // their operand types. Only OP_ADD works on more than one type, so only
+    // its forms fall back on a miss, to OP_ADD_GENERIC, which never quickens
+    // again; a miss in any other form is a type error.
+    OP_ADD_NUM,
+    OP_ADD_STRING,
+    OP_ADD_GENERIC,
+    OP_SUBTRACT_NUM,
+    OP_MULTIPLY_NUM,
+    OP_DIVIDE_NUM,
+    OP_NEGATE_NUM,
+    OP_GREATER_NUM,
+    OP_GREATER_EQUAL_NUM,
+    OP_LESS_NUM,
+    OP_LESS_EQUAL_NUM,
+
+    // Emitted by the compiler where it has proven both operands are numbers,
+    // so they skip the type checks entirely.
+    OP_ADD_UNCHECKED,
+    OP_SUBTRACT_UNCHECKED,
+    OP_MULTIPLY_UNCHECKED,
+    OP_DIVIDE_UNCHECKED,
+    OP_NEGATE_UNCHECKED,
+    OP_GREATER_UNCHECKED,
+    OP_GREATER_EQUAL_UNCHECKED,
+    OP_LESS_UNCHECKED,
+    OP_LESS_EQUAL_UNCHECKED,
+
+    // Never emitted: run_budget() writes it over the instruction a budgeted
+    // run has to stop before and puts that instruction back afterwards.
+    OP_YIELD,
 
     OP_RETURN,
 } OpCode;
 
+#define OPCODE_COUNT (OP_RETURN + 1)
+
 typedef struct {
     uint8_t* code;
     //todo optimize this.
@@ -44,8 +108,18 @@ typedef struct {
     ValueArray constants;
     int count;
     int capacity;
+    // Deepest the stack gets while running this chunk, worked out by the
+    // compiler so the VM can size its stack once instead of on every push.
+    int maxStack;
 } Chunk;
 
+// Net number of values each instruction pushes onto the stack.
+extern const int8_t stackEffects[];
+// How many operand bytes follow each opcode in the code.
+extern const uint8_t operandBytes[];
+// Each opcode's name as the disassembler prints it.
+extern const char* const opcodeNames[];
+
 void init_chunk(Chunk* chunk);
 void free_chunk(Chunk* chunk);
 
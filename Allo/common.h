@@ -10,9 +10,13 @@
 #define RUNTIME_ERROR 65
 #define COMPILER_ERROR 70
 #define SOURCE_FILE_READING_ERROR 74
+#define TIMEOUT_ERROR 75
 
+// Configure with -DALLO_DEBUG=OFF to build without the tracer and disassembler.
+#ifndef ALLO_NO_DEBUG
 #define ALLO_DEBUG_TRACE_EXECUTION
 #define ALLO_DEBUG_PRINT_CODE
+#endif
 
 #define UINT8_COUNT (UINT8_MAX + 1)
 
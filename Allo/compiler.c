@@ -8,8 +8,13 @@
 
 #include <string.h>
 
+#include "ir.h"
+#include "list.h"
+#include "number.h"
 #include "object.h"
 #include "scanner.h"
+#include "trace.h"
+#include "virtual_machine.h"
 
 typedef struct {
     Token current;
@@ -44,10 +49,25 @@ typedef struct {
     int depth;
 } Local;
 
+// What the compiler can prove about a value on the stack.
+typedef enum {
+    TYPE_UNKNOWN,
+    TYPE_NUMBER,
+} StaticType;
+
+#define TYPE_STACK_MAX (UINT8_COUNT * 2)
+
 typedef struct {
     Local locals[UINT8_COUNT];
     int localCount;
     int scopeDepth;
+    int stackDepth;
+    // Mirrors the runtime stack, so locals are typed by their slot. Slots past
+    // the end are treated as unknown.
+    StaticType stackTypes[TYPE_STACK_MAX];
+    // Where instructions go above -O0, to be optimized and lowered into the
+    // chunk once the whole script is parsed.
+    Ir* ir;
 } Compiler;
 
 static void grouping(bool canAssign);
@@ -57,6 +77,9 @@ static void binary(bool canAssign);
 static void literal(bool canAssign);
 static void string(bool canAssign);
 static void variable(bool canAssign);
+static void list(bool canAssign);
+static void map(bool canAssign);
+static void subscript(bool canAssign);
 
 static void declaration();
 static void var_declaration();
@@ -66,10 +89,13 @@ ParseRule rules[] =
     {
   [TOKEN_LEFT_PAREN]    = {grouping, NULL,   PREC_NONE},
   [TOKEN_RIGHT_PAREN]   = {NULL,     NULL,   PREC_NONE},
-  [TOKEN_LEFT_BRACE]    = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_LEFT_BRACE]    = {map,      NULL,   PREC_NONE},
   [TOKEN_RIGHT_BRACE]   = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_LEFT_BRACKET]  = {list,     subscript, PREC_CALL},
+  [TOKEN_RIGHT_BRACKET] = {NULL,     NULL,   PREC_NONE},
   [TOKEN_COMMA]         = {NULL,     NULL,   PREC_NONE},
   [TOKEN_DOT]           = {NULL,     NULL,   PREC_NONE},
+  [TOKEN_COLON]         = {NULL,     NULL,   PREC_NONE},
   [TOKEN_MINUS]         = {unary,    binary, PREC_TERM},
   [TOKEN_PLUS]          = {NULL,     binary, PREC_TERM},
   [TOKEN_SEMICOLON]     = {NULL,     NULL,   PREC_NONE},
@@ -106,13 +132,16 @@ ParseRule rules[] =
   [TOKEN_EOF]           = {NULL,     NULL,   PREC_NONE},
 };
 
-Parser parser;
-Chunk* compilingChunk;
-Compiler* current = NULL;
+_Thread_local Parser parser;
+_Thread_local Chunk* compilingChunk;
+_Thread_local Compiler* current = NULL;
+_Thread_local int optimizationLevel = 0;
 
-static void init_compiler(Compiler* compiler) {
+static void init_compiler(Compiler* compiler, Ir* ir) {
     compiler->localCount = 0;
     compiler->scopeDepth = 0;
+    compiler->stackDepth = 0;
+    compiler->ir = ir;
     current = compiler;
 }
 
@@ -166,13 +195,65 @@ static void consume(TokenType type, const char* message) {
     error_at_current(message);
 }
 
+static StaticType slot_type(int slot) {
+    if (slot < 0 || slot >= TYPE_STACK_MAX) return TYPE_UNKNOWN;
+    return current->stackTypes[slot];
+}
+
+static void set_slot_type(int slot, StaticType type) {
+    if (slot < 0 || slot >= TYPE_STACK_MAX) return;
+    current->stackTypes[slot] = type;
+}
+
+// Type of the value `distance` slots below the top of the stack.
+static StaticType peek_type(int distance) {
+    return slot_type(current->stackDepth - 1 - distance);
+}
+
+static void set_top_type(StaticType type) {
+    set_slot_type(current->stackDepth - 1, type);
+}
+
+// The code is straight-line, so following each instruction's stack effect in
+// emission order gives the exact depth at every point. For the same reason the
+// types seen along the way are exact too: nothing can jump past an assignment.
+static void track_stack(uint8_t instruction) {
+    current->stackDepth += stackEffects[instruction];
+    if (current->stackDepth > current_chunk()->maxStack) {
+        current_chunk()->maxStack = current->stackDepth;
+    }
+
+    switch (instruction) {
+        case OP_POP:
+        case OP_PRINT:
+        case OP_DEFINE_GLOBAL:
+        case OP_RETURN:
+            break;
+        default:
+            // Whatever the instruction leaves on top is unknown until the
+            // caller says otherwise.
+            set_top_type(TYPE_UNKNOWN);
+            break;
+    }
+}
+
 static void emit_byte(uint8_t byte) {
+    track_stack(byte);
+    if (current->ir != NULL) {
+        write_ir(current->ir, byte, 0, parser.previous.line);
+        return;
+    }
     write_chunk(current_chunk(), byte, parser.previous.line);
 }
 
 static void emit_bytes(uint8_t byte1, uint8_t byte2) {
-    emit_byte(byte1);
-    emit_byte(byte2);
+    track_stack(byte1);
+    if (current->ir != NULL) {
+        write_ir(current->ir, byte1, byte2, parser.previous.line);
+        return;
+    }
+    write_chunk(current_chunk(), byte1, parser.previous.line);
+    write_chunk(current_chunk(), byte2, parser.previous.line);
 }
 
 static uint8_t make_constant(Value value) {
@@ -212,8 +293,16 @@ static void parse_precedence(Precedence precedence) {
     }
 }
 
+// Interns a constant string, timed as its own phase when tracing.
+static ObjString* intern_constant(const char* chars, int length) {
+    TRACE_BEGIN(PHASE_INTERN);
+    ObjString* string = copy_string(chars, length);
+    TRACE_END(PHASE_INTERN);
+    return string;
+}
+
 static uint8_t identifier_constant(Token* name) {
-    return make_constant(OBJ_VAL(copy_string(name->start, name->length)));
+    return make_constant(OBJ_VAL(intern_constant(name->start, name->length)));
 }
 
 static bool identifiers_equal(Token* a, Token* b) {
@@ -388,8 +477,9 @@ static void statement() {
 
 
 static void number(bool canAssign) {
-    double value = strtod(parser.previous.start, NULL);
+    double value = parse_number(parser.previous.start, parser.previous.length);
     emit_constant(NUMBER_VAL(value));
+    set_top_type(TYPE_NUMBER);
 }
 
 static void grouping(bool canAssign) {
@@ -403,7 +493,11 @@ static void unary(bool canAssign) {
     parse_precedence(PREC_UNARY);
     switch (opType) {
         case TOKEN_BANG:  emit_byte(OP_NOT); break;
-        case TOKEN_MINUS: emit_byte(OP_NEGATE); break;
+        case TOKEN_MINUS:
+            emit_byte(peek_type(0) == TYPE_NUMBER ? OP_NEGATE_UNCHECKED : OP_NEGATE);
+            // A negation that didn't raise an error produced a number.
+            set_top_type(TYPE_NUMBER);
+            break;
         default: return;
     }
 }
@@ -413,21 +507,43 @@ static void binary(bool canAssign) {
     ParseRule* rule = get_rule(operatorType);
     parse_precedence((Precedence)(rule->precedence + 1));
 
+    StaticType left = peek_type(1);
+    StaticType right = peek_type(0);
+    bool numbers = left == TYPE_NUMBER && right == TYPE_NUMBER;
+
+#define NUMERIC_OP(op) emit_byte(numbers ? op##_UNCHECKED : op)
     switch (operatorType) {
-        case TOKEN_PLUS:          emit_byte(OP_ADD); break;
-        case TOKEN_MINUS:         emit_byte(OP_SUBTRACT); break;
-        case TOKEN_STAR:          emit_byte(OP_MULTIPLY); break;
-        case TOKEN_SLASH:         emit_byte(OP_DIVIDE); break;
+        case TOKEN_PLUS:          NUMERIC_OP(OP_ADD); break;
+        case TOKEN_MINUS:         NUMERIC_OP(OP_SUBTRACT); break;
+        case TOKEN_STAR:          NUMERIC_OP(OP_MULTIPLY); break;
+        case TOKEN_SLASH:         NUMERIC_OP(OP_DIVIDE); break;
 
         case TOKEN_BANG_EQUAL:      emit_byte(OP_NOT_EQUAL); break;
         case TOKEN_EQUAL_EQUAL:     emit_byte(OP_EQUAL); break;
-        case TOKEN_GREATER:         emit_byte(OP_GREATER); break;
-        case TOKEN_GREATER_EQUAL:   emit_byte(OP_GREATER_EQUAL); break;
-        case TOKEN_LESS:            emit_byte(OP_LESS); break;
-        case TOKEN_LESS_EQUAL:      emit_byte(OP_LESS_EQUAL); break;
+        case TOKEN_GREATER:         NUMERIC_OP(OP_GREATER); break;
+        case TOKEN_GREATER_EQUAL:   NUMERIC_OP(OP_GREATER_EQUAL); break;
+        case TOKEN_LESS:            NUMERIC_OP(OP_LESS); break;
+        case TOKEN_LESS_EQUAL:      NUMERIC_OP(OP_LESS_EQUAL); break;
 
         default: return; // Unreachable.
     }
+#undef NUMERIC_OP
+
+    // A runtime type error ends the script, so any arithmetic that falls
+    // through to the next instruction produced a number. '+' also accepts two
+    // strings, so it needs one side to be known.
+    switch (operatorType) {
+        case TOKEN_PLUS:
+            if (left == TYPE_NUMBER || right == TYPE_NUMBER) set_top_type(TYPE_NUMBER);
+            break;
+        case TOKEN_MINUS:
+        case TOKEN_STAR:
+        case TOKEN_SLASH:
+            set_top_type(TYPE_NUMBER);
+            break;
+        default:
+            break;
+    }
 }
 
 static void literal(bool canAssign) {
@@ -440,10 +556,165 @@ static void literal(bool canAssign) {
 }
 
 static void string(bool canAssign) {
-    emit_constant(OBJ_VAL(copy_string(parser.previous.start + 1,
+    emit_constant(OBJ_VAL(intern_constant(parser.previous.start + 1,
                     parser.previous.length - 2)));
 }
 
+// Emits an instruction whose operand is only known later, returning where to
+// patch it in.
+static int emit_hint(uint8_t instruction) {
+    int operand;
+    if (current->ir != NULL) {
+        operand = current->ir->count;
+    } else {
+        operand = current_chunk()->count + 1;
+    }
+    emit_bytes(instruction, 0);
+    return operand;
+}
+
+// Sets a literal's size hint, saturating at what an operand holds.
+static void patch_hint(int operand, int count) {
+    uint8_t hint = count > UINT8_MAX ? UINT8_MAX : (uint8_t)count;
+    if (current->ir != NULL) {
+        current->ir->code[operand].operand = hint;
+    } else {
+        current_chunk()->code[operand] = hint;
+    }
+}
+
+// Emits NEW_LIST with the element count as a capacity hint, patched in once
+// the elements are parsed, then one APPEND per element.
+static void list(bool canAssign) {
+    int hint = emit_hint(OP_NEW_LIST);
+
+    int count = 0;
+    if (!check(TOKEN_RIGHT_BRACKET)) {
+        do {
+            if (check(TOKEN_RIGHT_BRACKET)) break;  // A trailing comma.
+            expression();
+            emit_byte(OP_APPEND);
+            count++;
+        } while (match(TOKEN_COMMA));
+    }
+    consume(TOKEN_RIGHT_BRACKET, "Expect ']' after list elements.");
+    patch_hint(hint, count);
+}
+
+// A '{' that starts a statement is a block, so this only sees maps. Like a
+// list, the map is sized for its entries up front.
+static void map(bool canAssign) {
+    int hint = emit_hint(OP_NEW_MAP);
+
+    int count = 0;
+    if (!check(TOKEN_RIGHT_BRACE)) {
+        do {
+            if (check(TOKEN_RIGHT_BRACE)) break;  // A trailing comma.
+            expression();
+            consume(TOKEN_COLON, "Expect ':' after map key.");
+            expression();
+            emit_byte(OP_ADD_ENTRY);
+            count++;
+        } while (match(TOKEN_COMMA));
+    }
+    consume(TOKEN_RIGHT_BRACE, "Expect '}' after map entries.");
+    patch_hint(hint, count);
+}
+
+// s[i:j], with nil standing in for a bound left out. A slice is a view of
+// the string, so there is nothing to assign to.
+static void slice(bool canAssign) {
+    if (check(TOKEN_RIGHT_BRACKET)) {
+        emit_byte(OP_NIL);
+    } else {
+        expression();
+    }
+    consume(TOKEN_RIGHT_BRACKET, "Expect ']' after slice.");
+    if (canAssign && check(TOKEN_EQUAL)) error_at_current("Can't assign to a slice.");
+    emit_byte(OP_SLICE);
+}
+
+static void subscript(bool canAssign) {
+    if (match(TOKEN_COLON)) {
+        emit_byte(OP_NIL);
+        slice(canAssign);
+        return;
+    }
+    expression();
+    if (match(TOKEN_COLON)) {
+        slice(canAssign);
+        return;
+    }
+    consume(TOKEN_RIGHT_BRACKET, "Expect ']' after index.");
+
+    if (canAssign && match(TOKEN_EQUAL)) {
+        expression();
+        StaticType type = peek_type(0);
+        emit_byte(OP_SET_INDEX);
+        set_top_type(type);
+    } else {
+        emit_byte(OP_GET_INDEX);
+    }
+}
+
+typedef struct {
+    const char* name;
+    int length;
+    OpCode op;
+    int arity;
+    StaticType result;
+} Builtin;
+
+// Without calls in the language, each builtin compiles straight to its
+// instruction. A name followed by '(' is only ever a builtin.
+static const Builtin builtins[] = {
+    {"len",    3, OP_LEN,         1, TYPE_NUMBER},
+    {"append", 6, OP_APPEND,      2, TYPE_UNKNOWN},
+    {"sum",    3, OP_SUM,         1, TYPE_NUMBER},
+    {"min",    3, OP_MIN,         1, TYPE_NUMBER},
+    {"max",    3, OP_MAX,         1, TYPE_NUMBER},
+    {"dot",    3, OP_DOT,         2, TYPE_NUMBER},
+    {"get",    3, OP_GET_DEFAULT, 3, TYPE_UNKNOWN},
+    {"delete", 6, OP_DELETE,      2, TYPE_UNKNOWN},
+    {"split",  5, OP_SPLIT,       2, TYPE_UNKNOWN},
+    {"find",   4, OP_FIND,        2, TYPE_NUMBER},
+};
+
+static const Builtin* find_builtin(Token* name) {
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+        const Builtin* builtin = &builtins[i];
+        if (builtin->length == name->length &&
+            memcmp(builtin->name, name->start, name->length) == 0) {
+            return builtin;
+        }
+    }
+    return NULL;
+}
+
+static void builtin_call(const Builtin* builtin) {
+    advance_compiler();  // The '('.
+
+    int count = 0;
+    if (!check(TOKEN_RIGHT_PAREN)) {
+        do {
+            expression();
+            count++;
+        } while (match(TOKEN_COMMA));
+    }
+    consume(TOKEN_RIGHT_PAREN, "Expect ')' after arguments.");
+
+    if (count != builtin->arity) {
+        char message[32];
+        snprintf(message, sizeof(message), "Expected %d argument%s.",
+                 builtin->arity, builtin->arity == 1 ? "" : "s");
+        error(message);
+        return;
+    }
+
+    emit_byte(builtin->op);
+    set_top_type(builtin->result);
+}
+
 static void named_variable(Token name, bool canAssign) {
     uint8_t getOp, setOp;
     int arg = resolve_local(current, &name);
@@ -460,19 +731,35 @@ static void named_variable(Token name, bool canAssign) {
 
     if (canAssign && match(TOKEN_EQUAL)) {
         expression();
+        StaticType type = peek_type(0);
         emit_bytes(setOp, (uint8_t)arg);
+        set_top_type(type);
+        if (setOp == OP_SET_LOCAL) set_slot_type(arg, type);
     } else {
         emit_bytes(getOp, (uint8_t)arg);
+        if (getOp == OP_GET_LOCAL) set_top_type(slot_type(arg));
     }
 }
 
 static void variable( bool canAssign) {
+    if (check(TOKEN_LEFT_PAREN)) {
+        const Builtin* builtin = find_builtin(&parser.previous);
+        if (builtin != NULL) {
+            builtin_call(builtin);
+            return;
+        }
+    }
     named_variable(parser.previous, canAssign);
 }
 
 
 static void end_compiler() {
     emit_byte(OP_RETURN);
+
+    if (current->ir != NULL && !parser.hadError) {
+        optimize_ir(current->ir, current_chunk(), optimizationLevel);
+        lower_ir(current->ir, current_chunk());
+    }
 #ifdef ALLO_DEBUG_PRINT_CODE
     if (!parser.hadError) {
         disassemble_chunk(current_chunk(), "code");
@@ -481,33 +768,60 @@ static void end_compiler() {
 }
 
 
+static void compile_declarations(void* context) {
+    (void)context;
+    advance_compiler();
+
+    while (!match(TOKEN_EOF)) {
+        declaration();
+    }
+
+    end_compiler();
+}
+
 bool compile(const char *source, Chunk *chunk) {
+    TRACE_BEGIN(PHASE_COMPILE);
     init_scanner(source);
 
+    Ir ir;
+    init_ir(&ir);
+
     Compiler compiler;
-    init_compiler(&compiler);
+    init_compiler(&compiler, optimizationLevel > 0 ? &ir : NULL);
 
     parser.hadError = false;
     parser.panicMode = false;
 
     compilingChunk = chunk;
 
-    advance_compiler();
-
-    while (!match(TOKEN_EOF)) {
-        declaration();
+    // Running out of memory is one more compile error; the chunk and the IR
+    // are left in a state their free functions can clean up.
+    if (!run_protected(compile_declarations, NULL)) {
+        parser.panicMode = false;
+        error("Out of memory.");
     }
-
-    end_compiler();
+    free_ir(&ir);
+    TRACE_END(PHASE_COMPILE);
     return !parser.hadError;
 
 }
 
+void set_optimization_level(int level) {
+    optimizationLevel = level;
+}
+
 void advance_compiler() {
     parser.previous = parser.current;
 
     for (;;) {
-        parser.current = scan_token();
+        if (TRACING()) {
+            uint64_t start = trace_clock();
+            parser.current = scan_token();
+            trace.scanNs += trace_clock() - start;
+            trace.tokens++;
+        } else {
+            parser.current = scan_token();
+        }
         if (parser.current.type != TOKEN_ERROR) break;
 
         error_at_current(parser.current.start);
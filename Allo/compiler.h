@@ -4,5 +4,7 @@
 #include "virtual_machine.h"
 
 bool compile(const char* source, Chunk* chunk);
+// 0 compiles straight to bytecode; 1 and 2 run the passes in ir.h.
+void set_optimization_level(int level);
 void advance_compiler();
 #endif
@@ -31,6 +31,8 @@ int disassemble_instruction(Chunk* chunk, int offset) {
     switch (instruction) {
         case OP_RETURN:
             return simple_instruction("OP_RETURN", offset);
+        case OP_YIELD:
+            return simple_instruction("OP_YIELD", offset);
 
         case OP_NEGATE:
             return simple_instruction("OP_NEGATE", offset);
@@ -74,6 +76,8 @@ int disassemble_instruction(Chunk* chunk, int offset) {
             return simple_instruction("OP_PRINT", offset);
         case OP_POP:
             return simple_instruction("OP_POP", offset);
+        case OP_DUP:
+            return simple_instruction("OP_DUP", offset);
         case OP_DEFINE_GLOBAL:
             return constant_instruction("OP_DEFINE_GLOBAL", chunk, offset);
         case OP_GET_GLOBAL:
@@ -84,6 +88,82 @@ int disassemble_instruction(Chunk* chunk, int offset) {
             return byte_instruction("OP_GET_LOCAL", chunk, offset);
         case OP_SET_LOCAL:
             return byte_instruction("OP_SET_LOCAL", chunk, offset);
+
+        case OP_NEW_LIST:
+            return byte_instruction("OP_NEW_LIST", chunk, offset);
+        case OP_APPEND:
+            return simple_instruction("OP_APPEND", offset);
+        case OP_GET_INDEX:
+            return simple_instruction("OP_GET_INDEX", offset);
+        case OP_SET_INDEX:
+            return simple_instruction("OP_SET_INDEX", offset);
+        case OP_LEN:
+            return simple_instruction("OP_LEN", offset);
+        case OP_SUM:
+            return simple_instruction("OP_SUM", offset);
+        case OP_MIN:
+            return simple_instruction("OP_MIN", offset);
+        case OP_MAX:
+            return simple_instruction("OP_MAX", offset);
+        case OP_DOT:
+            return simple_instruction("OP_DOT", offset);
+
+        case OP_NEW_MAP:
+            return byte_instruction("OP_NEW_MAP", chunk, offset);
+        case OP_ADD_ENTRY:
+            return simple_instruction("OP_ADD_ENTRY", offset);
+        case OP_DELETE:
+            return simple_instruction("OP_DELETE", offset);
+        case OP_GET_DEFAULT:
+            return simple_instruction("OP_GET_DEFAULT", offset);
+
+        case OP_SLICE:
+            return simple_instruction("OP_SLICE", offset);
+        case OP_SPLIT:
+            return simple_instruction("OP_SPLIT", offset);
+        case OP_FIND:
+            return simple_instruction("OP_FIND", offset);
+
+        case OP_ADD_NUM:
+            return simple_instruction("OP_ADD_NUM", offset);
+        case OP_ADD_STRING:
+            return simple_instruction("OP_ADD_STRING", offset);
+        case OP_ADD_GENERIC:
+            return simple_instruction("OP_ADD_GENERIC", offset);
+        case OP_SUBTRACT_NUM:
+            return simple_instruction("OP_SUBTRACT_NUM", offset);
+        case OP_MULTIPLY_NUM:
+            return simple_instruction("OP_MULTIPLY_NUM", offset);
+        case OP_DIVIDE_NUM:
+            return simple_instruction("OP_DIVIDE_NUM", offset);
+        case OP_NEGATE_NUM:
+            return simple_instruction("OP_NEGATE_NUM", offset);
+        case OP_GREATER_NUM:
+            return simple_instruction("OP_GREATER_NUM", offset);
+        case OP_GREATER_EQUAL_NUM:
+            return simple_instruction("OP_GREATER_EQUAL_NUM", offset);
+        case OP_LESS_NUM:
+            return simple_instruction("OP_LESS_NUM", offset);
+        case OP_LESS_EQUAL_NUM:
+            return simple_instruction("OP_LESS_EQUAL_NUM", offset);
+        case OP_ADD_UNCHECKED:
+            return simple_instruction("OP_ADD_UNCHECKED", offset);
+        case OP_SUBTRACT_UNCHECKED:
+            return simple_instruction("OP_SUBTRACT_UNCHECKED", offset);
+        case OP_MULTIPLY_UNCHECKED:
+            return simple_instruction("OP_MULTIPLY_UNCHECKED", offset);
+        case OP_DIVIDE_UNCHECKED:
+            return simple_instruction("OP_DIVIDE_UNCHECKED", offset);
+        case OP_NEGATE_UNCHECKED:
+            return simple_instruction("OP_NEGATE_UNCHECKED", offset);
+        case OP_GREATER_UNCHECKED:
+            return simple_instruction("OP_GREATER_UNCHECKED", offset);
+        case OP_GREATER_EQUAL_UNCHECKED:
+            return simple_instruction("OP_GREATER_EQUAL_UNCHECKED", offset);
+        case OP_LESS_UNCHECKED:
+            return simple_instruction("OP_LESS_UNCHECKED", offset);
+        case OP_LESS_EQUAL_UNCHECKED:
+            return simple_instruction("OP_LESS_EQUAL_UNCHECKED", offset);
         default:
             printf("unknown opcode %d\n", instruction);
             return offset + 1;
@@ -102,4 +182,89 @@ int constant_instruction(const char* name, Chunk* chunk, int offset) {
 int simple_instruction(const char* name, int offset) {
     printf("%s\n", name);
     return offset + 1;
-}
\ No newline at end of file
+}
+
+static const char* registerOpNames[] = {
+    [ROP_MOVE]                      = "MOVE",
+    [ROP_ADD]                       = "ADD",
+    [ROP_SUBTRACT]                  = "SUBTRACT",
+    [ROP_MULTIPLY]                  = "MULTIPLY",
+    [ROP_DIVIDE]                    = "DIVIDE",
+    [ROP_GREATER]                   = "GREATER",
+    [ROP_GREATER_EQUAL]             = "GREATER_EQUAL",
+    [ROP_LESS]                      = "LESS",
+    [ROP_LESS_EQUAL]                = "LESS_EQUAL",
+    [ROP_NEGATE]                    = "NEGATE",
+    [ROP_ADD_UNCHECKED]             = "ADD_UNCHECKED",
+    [ROP_SUBTRACT_UNCHECKED]        = "SUBTRACT_UNCHECKED",
+    [ROP_MULTIPLY_UNCHECKED]        = "MULTIPLY_UNCHECKED",
+    [ROP_DIVIDE_UNCHECKED]          = "DIVIDE_UNCHECKED",
+    [ROP_GREATER_UNCHECKED]         = "GREATER_UNCHECKED",
+    [ROP_GREATER_EQUAL_UNCHECKED]   = "GREATER_EQUAL_UNCHECKED",
+    [ROP_LESS_UNCHECKED]            = "LESS_UNCHECKED",
+    [ROP_LESS_EQUAL_UNCHECKED]      = "LESS_EQUAL_UNCHECKED",
+    [ROP_NEGATE_UNCHECKED]          = "NEGATE_UNCHECKED",
+    [ROP_EQUAL]                     = "EQUAL",
+    [ROP_NOT_EQUAL]                 = "NOT_EQUAL",
+    [ROP_NOT]                       = "NOT",
+    [ROP_GET_GLOBAL]                = "GET_GLOBAL",
+    [ROP_SET_GLOBAL]                = "SET_GLOBAL",
+    [ROP_DEFINE_GLOBAL]             = "DEFINE_GLOBAL",
+    [ROP_PRINT]                     = "PRINT",
+    [ROP_RETURN]                    = "RETURN",
+};
+
+// Slots print as r<n>; constants, nil, true and false print as their value.
+static void print_register(RegisterChunk* chunk, uint16_t reg) {
+    int constant = reg - chunk->slotCount;
+    int constantCount = chunk->constants->count;
+
+    if (constant < 0) {
+        printf(" r%d", reg);
+    } else if (constant < constantCount) {
+        printf(" '");
+        print_value(chunk->constants->values[constant]);
+        printf("'");
+    } else {
+        static const char* literals[] = {"nil", "true", "false"};
+        printf(" %s", literals[constant - constantCount]);
+    }
+}
+
+void disassemble_register_chunk(RegisterChunk* chunk, const char* name) {
+    printf("== %s (registers) ==\n", name);
+    for (int i = 0; i < chunk->count; i++) {
+        RegisterInstruction* instruction = &chunk->code[i];
+        printf("%04d ", i);
+        if (i > 0 && chunk->lines[i] == chunk->lines[i - 1]) {
+            printf("   | ");
+        } else {
+            printf("%4d ", chunk->lines[i]);
+        }
+
+        printf("%-24s", registerOpNames[instruction->op]);
+        switch (instruction->op) {
+            case ROP_RETURN:
+                break;
+            case ROP_PRINT:
+                print_register(chunk, instruction->a);
+                break;
+            case ROP_MOVE:
+            case ROP_NEGATE:
+            case ROP_NEGATE_UNCHECKED:
+            case ROP_NOT:
+            case ROP_GET_GLOBAL:
+            case ROP_SET_GLOBAL:
+            case ROP_DEFINE_GLOBAL:
+                print_register(chunk, instruction->a);
+                print_register(chunk, instruction->b);
+                break;
+            default:
+                print_register(chunk, instruction->a);
+                print_register(chunk, instruction->b);
+                print_register(chunk, instruction->c);
+                break;
+        }
+        printf("\n");
+    }
+}
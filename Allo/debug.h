@@ -3,10 +3,12 @@
 
 
 #include "chunk.h"
+#include "register_chunk.h"
 
 
 void disassemble_chunk(Chunk* chunk, const char* name);
 int disassemble_instruction(Chunk* chunk, int offset);
+void disassemble_register_chunk(RegisterChunk* chunk, const char* name);
 
 int simple_instruction(const char* name, int offset);
 int constant_instruction(const char* name, Chunk* chunk, int offset);
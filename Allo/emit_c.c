@@ -0,0 +1,326 @@
+#include "emit_c.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "memory.h"
+#include "object.h"
+
+// Scripts have no jumps, so the stack depth before every instruction is known
+// here and each stack slot becomes a C local: s0 is the bottom of the stack,
+// which is also where local 0 lives. String constants are interned once per
+// run into k<index>, named after the first constant with the same contents
+// since every reference to a global adds its name again.
+
+static void emit_number(FILE* out, double number) {
+    if (isnan(number)) {
+        fputs("NUMBER_VAL(NAN)", out);
+    } else if (isinf(number)) {
+        fputs(number < 0 ? "NUMBER_VAL(-INFINITY)" : "NUMBER_VAL(INFINITY)", out);
+    } else {
+        // 17 significant digits round-trip any double; the suffix keeps the
+        // literal a double so -0 stays negative.
+        char digits[32];
+        snprintf(digits, sizeof(digits), "%.17g", number);
+        bool isInteger = strpbrk(digits, ".e") == NULL;
+        fprintf(out, "NUMBER_VAL(%s%s)", digits, isInteger ? ".0" : "");
+    }
+}
+
+static void emit_string_literal(FILE* out, ObjString* string) {
+    fputc('"', out);
+    for (int i = 0; i < string->length; i++) {
+        unsigned char c = (unsigned char)string->chars[i];
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < ' ' || c > '~') {
+            // Octal escapes always take three digits, so a following digit
+            // can't run into them.
+            fprintf(out, "\\%03o", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static int string_index(Chunk* chunk, int index) {
+    for (int i = 0; i < index; i++) {
+        if (values_equal(chunk->constants.values[i], chunk->constants.values[index])) return i;
+    }
+    return index;
+}
+
+static void emit_constant(FILE* out, Chunk* chunk, int index) {
+    Value value = chunk->constants.values[index];
+    switch (value.type) {
+        case VAL_BOOL:   fputs(AS_BOOL(value) ? "BOOL_VAL(true)" : "BOOL_VAL(false)", out); break;
+        case VAL_NIL:    fputs("NIL_VAL", out); break;
+        case VAL_NUMBER: emit_number(out, AS_NUMBER(value)); break;
+        case VAL_OBJ:    fprintf(out, "OBJ_VAL(k%d)", string_index(chunk, index)); break;
+    }
+}
+
+static bool names_constant(uint8_t op) {
+    return operandBytes[op] != 0 && op != OP_GET_LOCAL && op != OP_SET_LOCAL &&
+           op != OP_NEW_LIST && op != OP_NEW_MAP;
+}
+
+static void emit_strings(FILE* out, Chunk* chunk) {
+    bool* used = ALLOCATE(bool, chunk->constants.count);
+    for (int i = 0; i < chunk->constants.count; i++) used[i] = false;
+    for (int offset = 0; offset < chunk->count; offset += 1 + operandBytes[chunk->code[offset]]) {
+        if (names_constant(chunk->code[offset])) {
+            used[string_index(chunk, chunk->code[offset + 1])] = true;
+        }
+    }
+
+    for (int i = 0; i < chunk->constants.count; i++) {
+        Value value = chunk->constants.values[i];
+        if (!used[i] || !IS_STRING(value)) continue;
+        fprintf(out, "    ObjString* k%d = copy_string(", i);
+        emit_string_literal(out, AS_STRING(value));
+        fprintf(out, ", %d);\n", AS_STRING(value)->length);
+    }
+    FREE_ARRAY(bool, used, chunk->constants.count);
+}
+
+static void emit_error(FILE* out, int line, const char* message) {
+    fprintf(out, "runtime_error_at(%d, \"%s\"); return INTERPRET_RUNTIME_ERROR; }\n", line, message);
+}
+
+static void emit_checked(FILE* out, int line, int left, int right,
+                         const char* valueType, const char* op) {
+    fprintf(out, "    if (!IS_NUMBER(s%d) || !IS_NUMBER(s%d)) { ", left, right);
+    emit_error(out, line, "Operands must be numbers.");
+    fprintf(out, "    s%d = %s(AS_NUMBER(s%d) %s AS_NUMBER(s%d));\n",
+            left, valueType, left, op, right);
+}
+
+// Calls one of the list.h, map.h or text.h helpers, raising the error it
+// returns. The call is formatted straight into `out`, so no operand can be
+// cut short.
+static void emit_helper_call(FILE* out, int line, const char* format, ...) {
+    fprintf(out, "    { const char* error = ");
+    va_list args;
+    va_start(args, format);
+    vfprintf(out, format, args);
+    va_end(args);
+    fprintf(out, "; if (error != NULL) { ");
+    fprintf(out, "runtime_error_at(%d, \"%%s\", error); return INTERPRET_RUNTIME_ERROR; } }\n", line);
+}
+
+static void emit_unchecked(FILE* out, int left, int right,
+                           const char* valueType, const char* op) {
+    fprintf(out, "    s%d = %s(AS_NUMBER(s%d) %s AS_NUMBER(s%d));\n",
+            left, valueType, left, op, right);
+}
+
+bool emit_c(Chunk* chunk, const char* name, FILE* out) {
+    fprintf(out, "// Generated by allo --emit-c from %s. Build it against the runtime:\n", name);
+    fprintf(out, "//   cc -I<allo source dir> script.c <build dir>/liballo_runtime.a -lm\n\n");
+    fprintf(out, "#include <math.h>\n\n");
+    fprintf(out, "#include \"Allo/map.h\"\n");
+    fprintf(out, "#include \"Allo/object.h\"\n");
+    fprintf(out, "#include \"Allo/text.h\"\n");
+    fprintf(out, "#include \"Allo/virtual_machine.h\"\n\n");
+    fprintf(out, "InterpretResult allo_script(void) {\n");
+
+    emit_strings(out, chunk);
+    if (chunk->maxStack > 0) {
+        fprintf(out, "    Value");
+        for (int slot = 0; slot < chunk->maxStack; slot++) {
+            fprintf(out, "%s s%d", slot == 0 ? "" : ",", slot);
+        }
+        fprintf(out, ";\n");
+        // The optimizer can leave a slot written but never read.
+        fprintf(out, "   ");
+        for (int slot = 0; slot < chunk->maxStack; slot++) fprintf(out, " (void)s%d;", slot);
+        fprintf(out, "\n");
+    }
+
+    int depth = 0;
+    int line = -1;
+    for (int offset = 0; offset < chunk->count; ) {
+        uint8_t op = chunk->code[offset];
+        uint8_t operand = operandBytes[op] != 0 ? chunk->code[offset + 1] : 0;
+        if (chunk->lines[offset] != line) {
+            line = chunk->lines[offset];
+            fprintf(out, "\n    // line %d\n", line);
+        }
+        offset += 1 + operandBytes[op];
+
+        int top = depth - 1;
+        int next = depth - 2;
+        int name = names_constant(op) ? string_index(chunk, operand) : 0;
+        switch (op) {
+            case OP_CONSTANT:
+                fprintf(out, "    s%d = ", depth);
+                emit_constant(out, chunk, operand);
+                fprintf(out, ";\n");
+                break;
+            case OP_NIL:   fprintf(out, "    s%d = NIL_VAL;\n", depth); break;
+            case OP_TRUE:  fprintf(out, "    s%d = BOOL_VAL(true);\n", depth); break;
+            case OP_FALSE: fprintf(out, "    s%d = BOOL_VAL(false);\n", depth); break;
+
+            case OP_ADD:
+            case OP_ADD_NUM:
+            case OP_ADD_STRING:
+            case OP_ADD_GENERIC:
+                fprintf(out, "    if (IS_NUMBER(s%d) && IS_NUMBER(s%d)) {\n", next, top);
+                fprintf(out, "        s%d = NUMBER_VAL(AS_NUMBER(s%d) + AS_NUMBER(s%d));\n",
+                        next, next, top);
+                fprintf(out, "    } else if (IS_TEXT(s%d) && IS_TEXT(s%d)) {\n", next, top);
+                fprintf(out, "        s%d = concatenate(s%d, s%d);\n",
+                        next, next, top);
+                fprintf(out, "    } else { ");
+                emit_error(out, line, "Operands must be two numbers or two strings");
+                break;
+            case OP_SUBTRACT:
+            case OP_SUBTRACT_NUM:       emit_checked(out, line, next, top, "NUMBER_VAL", "-"); break;
+            case OP_MULTIPLY:
+            case OP_MULTIPLY_NUM:       emit_checked(out, line, next, top, "NUMBER_VAL", "*"); break;
+            case OP_DIVIDE:
+            case OP_DIVIDE_NUM:         emit_checked(out, line, next, top, "NUMBER_VAL", "/"); break;
+            case OP_GREATER:
+            case OP_GREATER_NUM:        emit_checked(out, line, next, top, "BOOL_VAL", ">"); break;
+            case OP_GREATER_EQUAL:
+            case OP_GREATER_EQUAL_NUM:  emit_checked(out, line, next, top, "BOOL_VAL", ">="); break;
+            case OP_LESS:
+            case OP_LESS_NUM:           emit_checked(out, line, next, top, "BOOL_VAL", "<"); break;
+            case OP_LESS_EQUAL:
+            case OP_LESS_EQUAL_NUM:     emit_checked(out, line, next, top, "BOOL_VAL", "<="); break;
+            case OP_NEGATE:
+            case OP_NEGATE_NUM:
+                fprintf(out, "    if (!IS_NUMBER(s%d)) { ", top);
+                emit_error(out, line, "Operand must be a number.");
+                fprintf(out, "    s%d = NUMBER_VAL(-AS_NUMBER(s%d));\n", top, top);
+                break;
+
+            case OP_ADD_UNCHECKED:            emit_unchecked(out, next, top, "NUMBER_VAL", "+"); break;
+            case OP_SUBTRACT_UNCHECKED:       emit_unchecked(out, next, top, "NUMBER_VAL", "-"); break;
+            case OP_MULTIPLY_UNCHECKED:       emit_unchecked(out, next, top, "NUMBER_VAL", "*"); break;
+            case OP_DIVIDE_UNCHECKED:         emit_unchecked(out, next, top, "NUMBER_VAL", "/"); break;
+            case OP_GREATER_UNCHECKED:        emit_unchecked(out, next, top, "BOOL_VAL", ">"); break;
+            case OP_GREATER_EQUAL_UNCHECKED:  emit_unchecked(out, next, top, "BOOL_VAL", ">="); break;
+            case OP_LESS_UNCHECKED:           emit_unchecked(out, next, top, "BOOL_VAL", "<"); break;
+            case OP_LESS_EQUAL_UNCHECKED:     emit_unchecked(out, next, top, "BOOL_VAL", "<="); break;
+            case OP_NEGATE_UNCHECKED:
+                fprintf(out, "    s%d = NUMBER_VAL(-AS_NUMBER(s%d));\n", top, top);
+                break;
+
+            case OP_NOT:
+                fprintf(out, "    s%d = BOOL_VAL(IS_NIL(s%d) || (IS_BOOL(s%d) && !AS_BOOL(s%d)));\n",
+                        top, top, top, top);
+                break;
+            case OP_EQUAL:
+                fprintf(out, "    s%d = BOOL_VAL(values_equal(s%d, s%d));\n", next, next, top);
+                break;
+            case OP_NOT_EQUAL:
+                fprintf(out, "    s%d = BOOL_VAL(!values_equal(s%d, s%d));\n", next, next, top);
+                break;
+
+            case OP_PRINT:
+                fprintf(out, "    write_value(&vm.output, s%d);\n", top);
+                fprintf(out, "    write_output_char(&vm.output, '\\n');\n");
+                break;
+            case OP_POP:
+                break;
+            case OP_DUP:
+                fprintf(out, "    s%d = s%d;\n", depth, top);
+                break;
+
+            case OP_DEFINE_GLOBAL:
+                fprintf(out, "    table_set(&vm.globals, k%d, s%d);\n", name, top);
+                break;
+            case OP_GET_GLOBAL:
+                fprintf(out, "    if (!table_get(&vm.globals, k%d, &s%d)) { ", name, depth);
+                fprintf(out, "runtime_error_at(%d, \"Undefined variable '%%s'.\", k%d->chars); "
+                             "return INTERPRET_RUNTIME_ERROR; }\n", line, name);
+                break;
+            case OP_SET_GLOBAL:
+                fprintf(out, "    if (table_set(&vm.globals, k%d, s%d)) {\n", name, top);
+                fprintf(out, "        table_delete(&vm.globals, k%d);\n", name);
+                fprintf(out, "        runtime_error_at(%d, \"Undefined variable '%%s'.\", k%d->chars);\n",
+                        line, name);
+                fprintf(out, "        return INTERPRET_RUNTIME_ERROR;\n    }\n");
+                break;
+            case OP_GET_LOCAL:
+                fprintf(out, "    s%d = s%d;\n", depth, operand);
+                break;
+            case OP_SET_LOCAL:
+                if (operand != top) fprintf(out, "    s%d = s%d;\n", operand, top);
+                break;
+
+            case OP_NEW_LIST:
+                fprintf(out, "    s%d = OBJ_VAL(new_list(%d));\n", depth, operand);
+                break;
+            case OP_APPEND:
+                emit_helper_call(out, line, "list_append(s%d, s%d)", next, top);
+                break;
+            case OP_GET_INDEX:
+                emit_helper_call(out, line, "index_get(s%d, s%d, &s%d)", next, top, next);
+                break;
+            case OP_SET_INDEX:
+                emit_helper_call(out, line, "index_set(s%d, s%d, s%d)", depth - 3, next, top);
+                fprintf(out, "    s%d = s%d;\n", depth - 3, top);
+                break;
+            case OP_LEN:
+            case OP_SUM:
+            case OP_MIN:
+            case OP_MAX: {
+                const char* builtin = op == OP_LEN ? "len" : op == OP_SUM ? "sum"
+                                    : op == OP_MIN ? "min" : "max";
+                emit_helper_call(out, line, "builtin_%s(s%d, &s%d)", builtin, top, top);
+                break;
+            }
+            case OP_DOT:
+                emit_helper_call(out, line, "builtin_dot(s%d, s%d, &s%d)", next, top, next);
+                break;
+
+            case OP_NEW_MAP:
+                fprintf(out, "    s%d = OBJ_VAL(new_map(%d));\n", depth, operand);
+                break;
+            case OP_ADD_ENTRY:
+                emit_helper_call(out, line, "map_add_entry(s%d, s%d, s%d)", depth - 3, next, top);
+                break;
+            case OP_DELETE:
+                emit_helper_call(out, line, "map_delete(s%d, s%d, &s%d)", next, top, next);
+                break;
+            case OP_GET_DEFAULT:
+                emit_helper_call(out, line, "map_get_default(s%d, s%d, s%d, &s%d)",
+                                 depth - 3, next, top, depth - 3);
+                break;
+
+            case OP_SLICE:
+                emit_helper_call(out, line, "text_slice(s%d, s%d, s%d, &s%d)",
+                                 depth - 3, next, top, depth - 3);
+                break;
+            case OP_SPLIT:
+            case OP_FIND:
+                emit_helper_call(out, line, "builtin_%s(s%d, s%d, &s%d)",
+                                 op == OP_SPLIT ? "split" : "find", next, top, next);
+                break;
+
+            case OP_RETURN:
+                fprintf(out, "    return INTERPRET_OK;\n");
+                break;
+
+            default:
+                return false;
+        }
+        depth += stackEffects[op];
+    }
+
+    fprintf(out, "}\n\n");
+    fprintf(out, "#ifndef ALLO_SCRIPT_NO_MAIN\n");
+    fprintf(out, "int main(void) {\n");
+    fprintf(out, "    init_vm();\n");
+    fprintf(out, "    InterpretResult result = allo_script();\n");
+    fprintf(out, "    free_vm();\n");
+    fprintf(out, "    return result == INTERPRET_OK ? 0 : RUNTIME_ERROR;\n");
+    fprintf(out, "}\n");
+    fprintf(out, "#endif\n");
+    return true;
+}
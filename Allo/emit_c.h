@@ -0,0 +1,15 @@
+#ifndef allo_emit_c_h
+#define allo_emit_c_h
+
+#include <stdio.h>
+
+#include "chunk.h"
+
+// Writes a C translation unit doing what `chunk` does, linked against the
+// allo_runtime library. It defines `InterpretResult allo_script(void)`, which
+// runs the script once on the calling thread's VM, and a main() that runs it
+// unless ALLO_SCRIPT_NO_MAIN is defined. `name` only appears in comments.
+// Fails on an instruction it doesn't know.
+bool emit_c(Chunk* chunk, const char* name, FILE* out);
+
+#endif //allo_emit_c_h
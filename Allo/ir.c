@@ -0,0 +1,532 @@
+#include "ir.h"
+
+#include <string.h>
+
+#include "memory.h"
+#include "object.h"
+
+// Marks an instruction a pass has removed until the code is compacted.
+#define IR_DELETED UINT8_MAX
+
+void init_ir(Ir* ir) {
+    ir->code = NULL;
+    ir->count = 0;
+    ir->capacity = 0;
+}
+
+void free_ir(Ir* ir) {
+    FREE_ARRAY(IrInstruction, ir->code, ir->capacity);
+    init_ir(ir);
+}
+
+void write_ir(Ir* ir, uint8_t op, uint8_t operand, int line) {
+    if (ir->capacity < ir->count + 1) {
+        int oldCapacity = ir->capacity;
+        int capacity = GROW_CAPACITY(oldCapacity);
+        ir->code = GROW_ARRAY(IrInstruction, ir->code, oldCapacity, capacity);
+        ir->capacity = capacity;
+    }
+
+    IrInstruction* instruction = &ir->code[ir->count++];
+    instruction->op = op;
+    instruction->operand = operand;
+    instruction->line = line;
+}
+
+// Number of values an instruction pops. What it pushes is this plus its
+// stack effect.
+static int input_count(uint8_t op) {
+    switch (op) {
+        case OP_CONSTANT:
+        case OP_NIL:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_GET_GLOBAL:
+        case OP_GET_LOCAL:
+        case OP_NEW_LIST:
+        case OP_NEW_MAP:
+        case OP_RETURN:
+            return 0;
+        case OP_NEGATE:
+        case OP_NEGATE_NUM:
+        case OP_NEGATE_UNCHECKED:
+        case OP_NOT:
+        case OP_PRINT:
+        case OP_POP:
+        case OP_DUP:
+        case OP_DEFINE_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_SET_LOCAL:
+        case OP_LEN:
+        case OP_SUM:
+        case OP_MIN:
+        case OP_MAX:
+            return 1;
+        case OP_SET_INDEX:
+        case OP_ADD_ENTRY:
+        case OP_GET_DEFAULT:
+        case OP_SLICE:
+            return 3;
+        default:
+            return 2;
+    }
+}
+
+static bool leaves_value(uint8_t op) {
+    return input_count(op) + stackEffects[op] > 0;
+}
+
+// Instructions that can neither fail nor change anything outside the stack,
+// so evaluating them twice or not at all is unobservable.
+static bool is_pure(uint8_t op) {
+    switch (op) {
+        case OP_CONSTANT:
+        case OP_NIL:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_GET_LOCAL:
+        case OP_DUP:
+        case OP_NOT:
+        case OP_EQUAL:
+        case OP_NOT_EQUAL:
+        case OP_ADD_UNCHECKED:
+        case OP_SUBTRACT_UNCHECKED:
+        case OP_MULTIPLY_UNCHECKED:
+        case OP_DIVIDE_UNCHECKED:
+        case OP_NEGATE_UNCHECKED:
+        case OP_GREATER_UNCHECKED:
+        case OP_GREATER_EQUAL_UNCHECKED:
+        case OP_LESS_UNCHECKED:
+        case OP_LESS_EQUAL_UNCHECKED:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Finds the first instruction of the expression whose value code[end] leaves
+// on top of the stack, or -1 if it reaches back past the start.
+static int expression_start(IrInstruction* code, int end) {
+    if (!leaves_value(code[end].op)) return -1;
+
+    int start = end;
+    int needed = input_count(code[end].op);
+    while (needed > 0) {
+        if (--start < 0) return -1;
+        uint8_t op = code[start].op;
+        needed -= input_count(op) + stackEffects[op];
+        // Part of what this pushes belongs to some other expression.
+        if (needed < 0) return -1;
+        needed += input_count(op);
+    }
+    return start;
+}
+
+static bool is_pure_range(IrInstruction* code, int start, int end) {
+    for (int i = start; i <= end; i++) {
+        if (!is_pure(code[i].op)) return false;
+    }
+    return true;
+}
+
+static void remove_deleted(Ir* ir) {
+    int count = 0;
+    for (int i = 0; i < ir->count; i++) {
+        if (ir->code[i].op != IR_DELETED) ir->code[count++] = ir->code[i];
+    }
+    ir->count = count;
+}
+
+typedef enum {
+    COPY_NONE,
+    COPY_LOCAL,
+    COPY_CONSTANT,
+} CopyKind;
+
+// What a stack slot is known to hold: the current value of another local, or
+// a constant.
+typedef struct {
+    CopyKind kind;
+    uint8_t index;
+} Copy;
+
+// Drops what is known about slots from `first` up, and every copy of them.
+static void forget_slots(Copy* known, int first) {
+    for (int slot = 0; slot < first; slot++) {
+        if (known[slot].kind == COPY_LOCAL && known[slot].index >= first) {
+            known[slot].kind = COPY_NONE;
+        }
+    }
+}
+
+static void forget_local(Copy* known, int depth, int local) {
+    for (int slot = 0; slot < depth; slot++) {
+        if (known[slot].kind == COPY_LOCAL && known[slot].index == local) {
+            known[slot].kind = COPY_NONE;
+        }
+    }
+}
+
+// Reads of a local that holds a copy of another local or of a constant read
+// the original instead, which leaves the copy unused and lets later passes see
+// the constant.
+static void propagate_copies(Ir* ir) {
+    Copy* known = ALLOCATE(Copy, ir->count + 1);
+    int depth = 0;
+
+    for (int i = 0; i < ir->count; i++) {
+        IrInstruction* instruction = &ir->code[i];
+
+        switch (instruction->op) {
+            case OP_CONSTANT:
+                known[depth++] = (Copy){COPY_CONSTANT, instruction->operand};
+                break;
+            case OP_GET_LOCAL: {
+                Copy copy = known[instruction->operand];
+                if (copy.kind == COPY_NONE) {
+                    copy = (Copy){COPY_LOCAL, instruction->operand};
+                } else {
+                    instruction->op = copy.kind == COPY_LOCAL ? OP_GET_LOCAL : OP_CONSTANT;
+                    instruction->operand = copy.index;
+                }
+                known[depth++] = copy;
+                break;
+            }
+            case OP_SET_LOCAL: {
+                uint8_t local = instruction->operand;
+                Copy value = known[depth - 1];
+                // Assigning a local its own value changes nothing.
+                if (value.kind == COPY_LOCAL && value.index == local) break;
+
+                forget_local(known, depth, local);
+                known[local] = value;
+                break;
+            }
+            case OP_SET_GLOBAL:
+                break;
+            default: {
+                depth += stackEffects[instruction->op];
+                if (leaves_value(instruction->op)) {
+                    forget_slots(known, depth - 1);
+                    known[depth - 1].kind = COPY_NONE;
+                } else {
+                    forget_slots(known, depth);
+                }
+                break;
+            }
+        }
+    }
+
+    FREE_ARRAY(Copy, known, ir->count + 1);
+}
+
+// A store is dead when the local is stored to again, or goes out of scope,
+// before anything reads it.
+static bool is_dead_store(Ir* ir, int store, int depth) {
+    uint8_t local = ir->code[store].operand;
+
+    for (int i = store + 1; i < ir->count; i++) {
+        IrInstruction* instruction = &ir->code[i];
+        if (instruction->op == IR_DELETED) continue;
+
+        if (instruction->op == OP_GET_LOCAL && instruction->operand == local) return false;
+        if (instruction->op == OP_SET_LOCAL && instruction->operand == local) return true;
+        if (instruction->op == OP_RETURN) return true;
+
+        depth += stackEffects[instruction->op];
+        if (depth <= local) return true;
+    }
+
+    return true;
+}
+
+// The assigned value stays on the stack either way, so a dead store is just
+// dropped. An assignment statement then becomes a pure expression and a POP.
+static void eliminate_dead_stores(Ir* ir) {
+    int depth = 0;
+    for (int i = 0; i < ir->count; i++) {
+        uint8_t op = ir->code[i].op;
+        if (op == OP_SET_LOCAL && is_dead_store(ir, i, depth)) {
+            ir->code[i].op = IR_DELETED;
+            continue;
+        }
+        depth += stackEffects[op];
+    }
+
+    remove_deleted(ir);
+}
+
+// Expression statements whose value is discarded and can't fail or change
+// anything are removed along with their POP.
+static void remove_pure_pops(Ir* ir) {
+    int count = 0;
+    for (int i = 0; i < ir->count; i++) {
+        ir->code[count] = ir->code[i];
+
+        if (ir->code[count].op == OP_POP && count > 0) {
+            int start = expression_start(ir->code, count - 1);
+            // Only a value pushed right before the POP: an older one may be a
+            // local that instructions in between refer to by slot.
+            if (start != -1 && is_pure_range(ir->code, start, count - 1)) {
+                count = start;
+                continue;
+            }
+        }
+
+        count++;
+    }
+
+    ir->count = count;
+}
+
+// Unlike values_equal(), tells 0 from -0 and treats a NaN as equal to itself.
+static bool same_constant(Value a, Value b) {
+    if (IS_NUMBER(a) && IS_NUMBER(b)) {
+        double x = AS_NUMBER(a);
+        double y = AS_NUMBER(b);
+        return memcmp(&x, &y, sizeof(double)) == 0;
+    }
+    return values_equal(a, b);
+}
+
+static bool same_code(Chunk* chunk, IrInstruction* a, IrInstruction* b, int length) {
+    for (int i = 0; i < length; i++) {
+        if (a[i].op != b[i].op) return false;
+        if (operandBytes[a[i].op] == 0 || a[i].operand == b[i].operand) continue;
+
+        // The compiler adds a constant for every literal, so the same number
+        // written twice has two indexes.
+        if (a[i].op != OP_CONSTANT) return false;
+        Value* constants = chunk->constants.values;
+        if (!same_constant(constants[a[i].operand], constants[b[i].operand])) return false;
+    }
+    return true;
+}
+
+// A stack machine has nowhere to keep a value for later, so this only shares
+// a result that is still on the stack: when both operands of an operator are
+// the same pure expression, the second is replaced by a DUP of the first.
+static void eliminate_common_subexpressions(Ir* ir, Chunk* chunk) {
+    int count = 0;
+    for (int i = 0; i < ir->count; i++) {
+        IrInstruction instruction = ir->code[i];
+
+        if (input_count(instruction.op) == 2 && leaves_value(instruction.op) && count > 1) {
+            int rightStart = expression_start(ir->code, count - 1);
+            int leftStart = rightStart > 0 ? expression_start(ir->code, rightStart - 1) : -1;
+            int length = count - rightStart;
+
+            if (rightStart != -1 && leftStart != -1 && rightStart - leftStart == length &&
+                is_pure_range(ir->code, leftStart, count - 1) &&
+                same_code(chunk, &ir->code[leftStart], &ir->code[rightStart], length)) {
+                int line = ir->code[rightStart].line;
+                count = rightStart;
+                ir->code[count++] = (IrInstruction){OP_DUP, 0, line};
+            }
+        }
+
+        ir->code[count++] = instruction;
+    }
+
+    ir->count = count;
+}
+
+// Reads the value an instruction pushes if it is a literal.
+static bool constant_value(Chunk* chunk, IrInstruction* instruction, Value* value) {
+    switch (instruction->op) {
+        case OP_CONSTANT: *value = chunk->constants.values[instruction->operand]; return true;
+        case OP_NIL:      *value = NIL_VAL; return true;
+        case OP_TRUE:     *value = BOOL_VAL(true); return true;
+        case OP_FALSE:    *value = BOOL_VAL(false); return true;
+        default:          return false;
+    }
+}
+
+// Turns `value` back into an instruction, reusing an existing constant where
+// possible. Fails only when the chunk is out of constant slots.
+static bool make_constant_instruction(Chunk* chunk, Value value, int line,
+                                      IrInstruction* instruction) {
+    if (IS_BOOL(value)) {
+        *instruction = (IrInstruction){AS_BOOL(value) ? OP_TRUE : OP_FALSE, 0, line};
+        return true;
+    }
+    if (IS_NIL(value)) {
+        *instruction = (IrInstruction){OP_NIL, 0, line};
+        return true;
+    }
+
+    int constant = -1;
+    for (int i = 0; i < chunk->constants.count; i++) {
+        if (same_constant(chunk->constants.values[i], value)) {
+            constant = i;
+            break;
+        }
+    }
+    if (constant == -1) {
+        if (chunk->constants.count == UINT8_COUNT) return false;
+        constant = add_constant(chunk, value);
+    }
+
+    *instruction = (IrInstruction){OP_CONSTANT, (uint8_t)constant, line};
+    return true;
+}
+
+// Evaluates an operator on literal operands. Anything that could raise a
+// runtime error or would allocate, such as joining two strings, is left alone.
+static bool fold(uint8_t op, Value a, Value b, Value* result) {
+    switch (op) {
+        case OP_NOT:
+            *result = BOOL_VAL(IS_NIL(b) || (IS_BOOL(b) && !AS_BOOL(b)));
+            return true;
+        case OP_EQUAL:
+            *result = BOOL_VAL(values_equal(a, b));
+            return true;
+        case OP_NOT_EQUAL:
+            *result = BOOL_VAL(!values_equal(a, b));
+            return true;
+        case OP_NEGATE:
+        case OP_NEGATE_UNCHECKED:
+            if (!IS_NUMBER(b)) return false;
+            *result = NUMBER_VAL(-AS_NUMBER(b));
+            return true;
+        default:
+            break;
+    }
+
+    if (!IS_NUMBER(a) || !IS_NUMBER(b)) return false;
+    double x = AS_NUMBER(a);
+    double y = AS_NUMBER(b);
+
+    switch (op) {
+        case OP_ADD:
+        case OP_ADD_UNCHECKED:           *result = NUMBER_VAL(x + y); return true;
+        case OP_SUBTRACT:
+        case OP_SUBTRACT_UNCHECKED:      *result = NUMBER_VAL(x - y); return true;
+        case OP_MULTIPLY:
+        case OP_MULTIPLY_UNCHECKED:      *result = NUMBER_VAL(x * y); return true;
+        case OP_DIVIDE:
+        case OP_DIVIDE_UNCHECKED:        *result = NUMBER_VAL(x / y); return true;
+        case OP_GREATER:
+        case OP_GREATER_UNCHECKED:       *result = BOOL_VAL(x > y); return true;
+        case OP_GREATER_EQUAL:
+        case OP_GREATER_EQUAL_UNCHECKED: *result = BOOL_VAL(x >= y); return true;
+        case OP_LESS:
+        case OP_LESS_UNCHECKED:          *result = BOOL_VAL(x < y); return true;
+        case OP_LESS_EQUAL:
+        case OP_LESS_EQUAL_UNCHECKED:    *result = BOOL_VAL(x <= y); return true;
+        default:                         return false;
+    }
+}
+
+typedef struct {
+    ObjString* name;
+    int definitions;
+    int assignments;
+    bool known;
+    IrInstruction value;
+} GlobalUse;
+
+static GlobalUse* find_global(GlobalUse* globals, int count, ObjString* name) {
+    for (int i = 0; i < count; i++) {
+        if (globals[i].name == name) return &globals[i];
+    }
+    return NULL;
+}
+
+// Folds operators whose operands are literals, and replaces reads of a global
+// with its value when this chunk defines it exactly once, to a literal or
+// something that folds to one, and never assigns it. The definition stays so
+// the global still exists afterwards.
+//
+// Only reads after the definition are replaced, which is what keeps this safe
+// in the REPL: a global can only change from outside this chunk before the
+// chunk runs or after it has finished, and each line is its own chunk.
+static void propagate_constants(Ir* ir, Chunk* chunk) {
+    // Every global reference takes a constant slot, so there are few of them.
+    int capacity = chunk->constants.count;
+    GlobalUse* globals = ALLOCATE(GlobalUse, capacity);
+    int globalCount = 0;
+
+    for (int i = 0; i < ir->count; i++) {
+        uint8_t op = ir->code[i].op;
+        if (op != OP_DEFINE_GLOBAL && op != OP_SET_GLOBAL) continue;
+
+        ObjString* name = AS_STRING(chunk->constants.values[ir->code[i].operand]);
+        GlobalUse* global = find_global(globals, globalCount, name);
+        if (global == NULL) {
+            global = &globals[globalCount++];
+            *global = (GlobalUse){.name = name};
+        }
+        if (op == OP_DEFINE_GLOBAL) global->definitions++;
+        else global->assignments++;
+    }
+
+    int count = 0;
+    for (int i = 0; i < ir->count; i++) {
+        IrInstruction instruction = ir->code[i];
+        uint8_t op = instruction.op;
+
+        if (op == OP_GET_GLOBAL || op == OP_DEFINE_GLOBAL) {
+            ObjString* name = AS_STRING(chunk->constants.values[instruction.operand]);
+            GlobalUse* global = find_global(globals, globalCount, name);
+
+            if (op == OP_GET_GLOBAL && global != NULL && global->known) {
+                instruction = global->value;
+                instruction.line = ir->code[i].line;
+            } else if (op == OP_DEFINE_GLOBAL && global->definitions == 1 &&
+                       global->assignments == 0 && count > 0) {
+                Value value;
+                if (constant_value(chunk, &ir->code[count - 1], &value)) {
+                    global->known = true;
+                    global->value = ir->code[count - 1];
+                }
+            }
+        } else {
+            int inputs = input_count(op);
+            Value a = NIL_VAL;
+            Value b;
+            Value result;
+            if (leaves_value(op) && op != OP_DUP && op != OP_SET_GLOBAL &&
+                op != OP_SET_LOCAL && count >= inputs && inputs > 0 &&
+                constant_value(chunk, &ir->code[count - 1], &b) &&
+                (inputs == 1 || constant_value(chunk, &ir->code[count - 2], &a)) &&
+                fold(op, a, b, &result) &&
+                make_constant_instruction(chunk, result, instruction.line, &instruction)) {
+                count -= inputs;
+            }
+        }
+
+        ir->code[count++] = instruction;
+    }
+    ir->count = count;
+
+    FREE_ARRAY(GlobalUse, globals, capacity);
+}
+
+void optimize_ir(Ir* ir, Chunk* chunk, int level) {
+    if (level >= 1) {
+        propagate_constants(ir, chunk);
+        propagate_copies(ir);
+        // Locals that copy a folded value are constants now too.
+        propagate_constants(ir, chunk);
+    }
+    if (level >= 2) eliminate_dead_stores(ir);
+    if (level >= 1) remove_pure_pops(ir);
+    if (level >= 2) eliminate_common_subexpressions(ir, chunk);
+}
+
+void lower_ir(Ir* ir, Chunk* chunk) {
+    int depth = 0;
+    chunk->maxStack = 0;
+
+    for (int i = 0; i < ir->count; i++) {
+        IrInstruction* instruction = &ir->code[i];
+        write_chunk(chunk, instruction->op, instruction->line);
+        if (operandBytes[instruction->op] != 0) {
+            write_chunk(chunk, instruction->operand, instruction->line);
+        }
+
+        depth += stackEffects[instruction->op];
+        if (depth > chunk->maxStack) chunk->maxStack = depth;
+    }
+}
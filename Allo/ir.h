@@ -0,0 +1,33 @@
+#ifndef allo_ir_h
+#define allo_ir_h
+
+#include "chunk.h"
+
+// A bytecode instruction before it is encoded. Keeping the instructions
+// decoded lets the passes delete and rewrite them without shifting bytes and
+// patching operands.
+typedef struct {
+    uint8_t op;
+    uint8_t operand;
+    int line;
+} IrInstruction;
+
+typedef struct {
+    IrInstruction* code;
+    int count;
+    int capacity;
+} Ir;
+
+void init_ir(Ir* ir);
+void free_ir(Ir* ir);
+void write_ir(Ir* ir, uint8_t op, uint8_t operand, int line);
+
+// Runs the passes enabled at `level`: 1 propagates copies and drops unused
+// pure expressions, 2 also removes dead local stores and shares repeated
+// operands. `chunk` holds the constants the instructions refer to.
+void optimize_ir(Ir* ir, Chunk* chunk, int level);
+
+// Encodes the instructions into `chunk` and recomputes its stack depth.
+void lower_ir(Ir* ir, Chunk* chunk);
+
+#endif //allo_ir_h
@@ -0,0 +1,380 @@
+// MAP_ANONYMOUS is not part of strict C11 or POSIX.
+#define _DEFAULT_SOURCE
+
+#include "jit.h"
+
+#include <stddef.h>
+
+#include "memory.h"
+
+void init_jit_code(JitCode* jit) {
+    jit->function = NULL;
+    jit->code = NULL;
+    jit->size = 0;
+}
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "virtual_machine.h"
+
+// The templates address a Value's type and payload directly.
+_Static_assert(sizeof(Value) == 16, "templates assume 16-byte values");
+_Static_assert(offsetof(Value, as) == 8, "templates assume the payload at offset 8");
+
+// Offsets from the stack top (rbx) of the top value and the one below it.
+#define TOP          -16
+#define TOP_PAYLOAD  -8
+#define NEXT         -32
+#define NEXT_PAYLOAD -24
+
+typedef struct {
+    uint8_t* code;
+    int count;
+    int capacity;
+    // Offsets of the rel32 operands that jump to the shared error exit.
+    int* errorJumps;
+    int errorJumpCount;
+    int errorJumpCapacity;
+} Assembler;
+
+static void emit(Assembler* as, uint8_t byte) {
+    if (as->capacity < as->count + 1) {
+        int oldCapacity = as->capacity;
+        as->capacity = GROW_CAPACITY(oldCapacity);
+        as->code = GROW_ARRAY(uint8_t, as->code, oldCapacity, as->capacity);
+    }
+    as->code[as->count++] = byte;
+}
+
+static void emit_all(Assembler* as, const uint8_t* bytes, int count) {
+    for (int i = 0; i < count; i++) emit(as, bytes[i]);
+}
+
+#define EMIT(...)                                                       \
+    do {                                                                \
+        const uint8_t bytes[] = {__VA_ARGS__};                          \
+        emit_all(as, bytes, sizeof(bytes));                             \
+    } while (false)
+
+static void emit32(Assembler* as, uint32_t value) {
+    for (int i = 0; i < 4; i++) emit(as, (uint8_t)(value >> (8 * i)));
+}
+
+static void emit64(Assembler* as, uint64_t value) {
+    for (int i = 0; i < 8; i++) emit(as, (uint8_t)(value >> (8 * i)));
+}
+
+// Emits a rel32 placeholder and returns its offset for patch_jump().
+static int emit_jump_target(Assembler* as) {
+    int offset = as->count;
+    emit32(as, 0);
+    return offset;
+}
+
+static void patch_jump(Assembler* as, int offset) {
+    uint32_t distance = (uint32_t)(as->count - (offset + 4));
+    memcpy(&as->code[offset], &distance, sizeof(distance));
+}
+
+static void jump_to_error(Assembler* as) {
+    if (as->errorJumpCapacity < as->errorJumpCount + 1) {
+        int oldCapacity = as->errorJumpCapacity;
+        as->errorJumpCapacity = GROW_CAPACITY(oldCapacity);
+        as->errorJumps = GROW_ARRAY(int, as->errorJumps, oldCapacity, as->errorJumpCapacity);
+    }
+    as->errorJumps[as->errorJumpCount++] = emit_jump_target(as);
+}
+
+static void push_value(Assembler* as) {
+    EMIT(0xF3, 0x0F, 0x7F, 0x03);                   // movdqu [rbx], xmm0
+    EMIT(0x48, 0x83, 0xC3, 0x10);                   // add rbx, 16
+}
+
+static void drop(Assembler* as) {
+    EMIT(0x48, 0x83, 0xEB, 0x10);                   // sub rbx, 16
+}
+
+static void push_literal(Assembler* as, ValueType type, uint32_t payload) {
+    EMIT(0xC7, 0x03); emit32(as, type);             // mov dword [rbx], type
+    EMIT(0x48, 0xC7, 0x43, 0x08); emit32(as, payload); // mov qword [rbx+8], payload
+    EMIT(0x48, 0x83, 0xC3, 0x10);                   // add rbx, 16
+}
+
+// Everything without a template runs in C: execute_instruction() does what
+// run() would for the instruction and returns the new stack top, or NULL after
+// reporting a runtime error.
+static void call_helper(Assembler* as, uint8_t* ip) {
+    EMIT(0x48, 0x89, 0xDF);                         // mov rdi, rbx
+    EMIT(0x48, 0xBE); emit64(as, (uint64_t)(uintptr_t)ip); // mov rsi, ip
+    EMIT(0x48, 0xB8); emit64(as, (uint64_t)(uintptr_t)execute_instruction); // mov rax, helper
+    EMIT(0xFF, 0xD0);                               // call rax
+    EMIT(0x48, 0x85, 0xC0);                         // test rax, rax
+    EMIT(0x0F, 0x84); jump_to_error(as);            // jz error
+    EMIT(0x48, 0x89, 0xC3);                         // mov rbx, rax
+}
+
+// Jumps to the returned placeholder unless both operands are numbers.
+static void check_numbers(Assembler* as, int* notNumbers) {
+    EMIT(0x83, 0x7B, (uint8_t)NEXT, VAL_NUMBER);    // cmp dword [rbx-32], VAL_NUMBER
+    EMIT(0x0F, 0x85); notNumbers[0] = emit_jump_target(as); // jne
+    EMIT(0x83, 0x7B, (uint8_t)TOP, VAL_NUMBER);     // cmp dword [rbx-16], VAL_NUMBER
+    EMIT(0x0F, 0x85); notNumbers[1] = emit_jump_target(as); // jne
+}
+
+static void arithmetic(Assembler* as, uint8_t sseOp) {
+    EMIT(0xF2, 0x0F, 0x10, 0x43, (uint8_t)NEXT_PAYLOAD);  // movsd xmm0, [rbx-24]
+    EMIT(0xF2, 0x0F, sseOp, 0x43, (uint8_t)TOP_PAYLOAD);  // op xmm0, [rbx-8]
+    EMIT(0xF2, 0x0F, 0x11, 0x43, (uint8_t)NEXT_PAYLOAD);  // movsd [rbx-24], xmm0
+    drop(as);
+}
+
+// `setcc` is the second byte of a SETcc opcode; `swap` compares the operands
+// the other way round so < and <= can use the same unordered-safe conditions
+// as > and >=.
+static void comparison(Assembler* as, uint8_t setcc, bool swap) {
+    int8_t left = swap ? TOP_PAYLOAD : NEXT_PAYLOAD;
+    int8_t right = swap ? NEXT_PAYLOAD : TOP_PAYLOAD;
+    EMIT(0xF2, 0x0F, 0x10, 0x43, (uint8_t)left);    // movsd xmm0, left
+    EMIT(0x66, 0x0F, 0x2E, 0x43, (uint8_t)right);   // ucomisd xmm0, right
+    EMIT(0x0F, setcc, 0xC0);                        // setcc al
+    EMIT(0x0F, 0xB6, 0xC0);                         // movzx eax, al
+    EMIT(0xC7, 0x43, (uint8_t)NEXT); emit32(as, VAL_BOOL); // mov dword [rbx-32], VAL_BOOL
+    EMIT(0x48, 0x89, 0x43, (uint8_t)NEXT_PAYLOAD);  // mov [rbx-24], rax
+    drop(as);
+}
+
+// Inlines the number case and leaves everything else to the helper.
+static void guarded(Assembler* as, uint8_t* ip, void (*fast)(Assembler*, uint8_t, bool),
+                    uint8_t arg, bool swap) {
+    int notNumbers[2];
+    check_numbers(as, notNumbers);
+    fast(as, arg, swap);
+    EMIT(0xE9); int done = emit_jump_target(as);    // jmp done
+    patch_jump(as, notNumbers[0]);
+    patch_jump(as, notNumbers[1]);
+    call_helper(as, ip);
+    patch_jump(as, done);
+}
+
+static void arithmetic_template(Assembler* as, uint8_t sseOp, bool unused) {
+    (void)unused;
+    arithmetic(as, sseOp);
+}
+
+static void comparison_template(Assembler* as, uint8_t setcc, bool swap) {
+    comparison(as, setcc, swap);
+}
+
+#define ADDSD 0x58
+#define SUBSD 0x5C
+#define MULSD 0x59
+#define DIVSD 0x5E
+#define SETA  0x97
+#define SETAE 0x93
+
+static void negate(Assembler* as) {
+    EMIT(0x48, 0x0F, 0xBA, 0x7B, (uint8_t)TOP_PAYLOAD, 63); // btc qword [rbx-8], 63
+}
+
+static void write_perf_map(void* code, size_t size, const char* name) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+    FILE* map = fopen(path, "a");
+    if (map == NULL) return;
+    fprintf(map, "%lx %zx allo:%s\n", (unsigned long)(uintptr_t)code, size, name);
+    fclose(map);
+}
+
+static bool translate(Assembler* as, Chunk* chunk) {
+    // Prologue: keep the stack top in rbx, the slots in r12 and the constants
+    // in r13. Three pushes leave rsp 16-byte aligned for the helper calls.
+    EMIT(0x53);                                     // push rbx
+    EMIT(0x41, 0x54);                               // push r12
+    EMIT(0x41, 0x55);                               // push r13
+    EMIT(0x48, 0x89, 0xFB);                         // mov rbx, rdi
+    EMIT(0x49, 0x89, 0xF4);                         // mov r12, rsi
+    EMIT(0x49, 0x89, 0xD5);                         // mov r13, rdx
+
+    for (int offset = 0; offset < chunk->count; ) {
+        uint8_t op = chunk->code[offset];
+        uint8_t* ip = &chunk->code[offset + 1];
+        offset++;
+
+        switch (op) {
+            case OP_CONSTANT:
+                EMIT(0xF3, 0x41, 0x0F, 0x6F, 0x85); emit32(as, *ip * 16); // movdqu xmm0, [r13+k*16]
+                push_value(as);
+                offset++;
+                break;
+            case OP_NIL:   push_literal(as, VAL_NIL, 0); break;
+            case OP_TRUE:  push_literal(as, VAL_BOOL, 1); break;
+            case OP_FALSE: push_literal(as, VAL_BOOL, 0); break;
+
+            case OP_GET_LOCAL:
+                EMIT(0xF3, 0x41, 0x0F, 0x6F, 0x84, 0x24); emit32(as, *ip * 16); // movdqu xmm0, [r12+s*16]
+                push_value(as);
+                offset++;
+                break;
+            case OP_SET_LOCAL:
+                EMIT(0xF3, 0x0F, 0x6F, 0x43, (uint8_t)TOP); // movdqu xmm0, [rbx-16]
+                EMIT(0xF3, 0x41, 0x0F, 0x7F, 0x84, 0x24); emit32(as, *ip * 16); // movdqu [r12+s*16], xmm0
+                offset++;
+                break;
+            case OP_POP:
+                drop(as);
+                break;
+            case OP_DUP:
+                EMIT(0xF3, 0x0F, 0x6F, 0x43, (uint8_t)TOP); // movdqu xmm0, [rbx-16]
+                push_value(as);
+                break;
+
+            case OP_ADD:
+            case OP_ADD_GENERIC:
+            case OP_ADD_NUM:      guarded(as, ip, arithmetic_template, ADDSD, false); break;
+            case OP_SUBTRACT:
+            case OP_SUBTRACT_NUM: guarded(as, ip, arithmetic_template, SUBSD, false); break;
+            case OP_MULTIPLY:
+            case OP_MULTIPLY_NUM: guarded(as, ip, arithmetic_template, MULSD, false); break;
+            case OP_DIVIDE:
+            case OP_DIVIDE_NUM:   guarded(as, ip, arithmetic_template, DIVSD, false); break;
+            case OP_GREATER:
+            case OP_GREATER_NUM:        guarded(as, ip, comparison_template, SETA, false); break;
+            case OP_GREATER_EQUAL:
+            case OP_GREATER_EQUAL_NUM:  guarded(as, ip, comparison_template, SETAE, false); break;
+            case OP_LESS:
+            case OP_LESS_NUM:           guarded(as, ip, comparison_template, SETA, true); break;
+            case OP_LESS_EQUAL:
+            case OP_LESS_EQUAL_NUM:     guarded(as, ip, comparison_template, SETAE, true); break;
+
+            case OP_ADD_UNCHECKED:           arithmetic(as, ADDSD); break;
+            case OP_SUBTRACT_UNCHECKED:      arithmetic(as, SUBSD); break;
+            case OP_MULTIPLY_UNCHECKED:      arithmetic(as, MULSD); break;
+            case OP_DIVIDE_UNCHECKED:        arithmetic(as, DIVSD); break;
+            case OP_GREATER_UNCHECKED:       comparison(as, SETA, false); break;
+            case OP_GREATER_EQUAL_UNCHECKED: comparison(as, SETAE, false); break;
+            case OP_LESS_UNCHECKED:          comparison(as, SETA, true); break;
+            case OP_LESS_EQUAL_UNCHECKED:    comparison(as, SETAE, true); break;
+            case OP_NEGATE_UNCHECKED:        negate(as); break;
+
+            case OP_NEGATE:
+            case OP_NEGATE_NUM: {
+                EMIT(0x83, 0x7B, (uint8_t)TOP, VAL_NUMBER); // cmp dword [rbx-16], VAL_NUMBER
+                EMIT(0x0F, 0x85); int notNumber = emit_jump_target(as); // jne
+                negate(as);
+                EMIT(0xE9); int done = emit_jump_target(as); // jmp done
+                patch_jump(as, notNumber);
+                call_helper(as, ip);
+                patch_jump(as, done);
+                break;
+            }
+
+            case OP_DEFINE_GLOBAL:
+            case OP_GET_GLOBAL:
+            case OP_SET_GLOBAL:
+                call_helper(as, ip);
+                offset++;
+                break;
+
+            case OP_NEW_LIST:
+            case OP_NEW_MAP:
+                call_helper(as, ip);
+                offset++;
+                break;
+
+            case OP_APPEND:
+            case OP_GET_INDEX:
+            case OP_SET_INDEX:
+            case OP_LEN:
+            case OP_SUM:
+            case OP_MIN:
+            case OP_MAX:
+            case OP_DOT:
+            case OP_ADD_ENTRY:
+            case OP_DELETE:
+            case OP_GET_DEFAULT:
+            case OP_SLICE:
+            case OP_SPLIT:
+            case OP_FIND:
+            case OP_ADD_STRING:
+            case OP_NOT:
+            case OP_EQUAL:
+            case OP_NOT_EQUAL:
+            case OP_PRINT:
+                call_helper(as, ip);
+                break;
+
+            case OP_RETURN:
+                EMIT(0x31, 0xC0);                   // xor eax, eax (INTERPRET_OK)
+                EMIT(0x41, 0x5D);                   // pop r13
+                EMIT(0x41, 0x5C);                   // pop r12
+                EMIT(0x5B);                         // pop rbx
+                EMIT(0xC3);                         // ret
+                break;
+
+            default:
+                return false;
+        }
+    }
+
+    // Shared error exit for failed helper calls.
+    for (int i = 0; i < as->errorJumpCount; i++) patch_jump(as, as->errorJumps[i]);
+    EMIT(0xB8); emit32(as, INTERPRET_RUNTIME_ERROR); // mov eax, INTERPRET_RUNTIME_ERROR
+    EMIT(0x41, 0x5D);                               // pop r13
+    EMIT(0x41, 0x5C);                               // pop r12
+    EMIT(0x5B);                                     // pop rbx
+    EMIT(0xC3);                                     // ret
+    return true;
+}
+
+bool jit_compile(Chunk* chunk, const char* name, JitCode* jit) {
+    init_jit_code(jit);
+
+    Assembler as = {NULL, 0, 0, NULL, 0, 0};
+    bool translated = translate(&as, chunk);
+
+    if (translated) {
+        // Written while writable, then flipped to executable: never both.
+        void* code = mmap(NULL, as.count, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code != MAP_FAILED) {
+            memcpy(code, as.code, as.count);
+            if (mprotect(code, as.count, PROT_READ | PROT_EXEC) == 0) {
+                jit->function = (JitFunction)code;
+                jit->code = code;
+                jit->size = as.count;
+                write_perf_map(code, as.count, name);
+            } else {
+                munmap(code, as.count);
+            }
+        }
+    }
+
+    FREE_ARRAY(uint8_t, as.code, as.capacity);
+    FREE_ARRAY(int, as.errorJumps, as.errorJumpCapacity);
+    return jit->function != NULL;
+}
+
+void free_jit_code(JitCode* jit) {
+    if (jit->code != NULL) munmap(jit->code, jit->size);
+    init_jit_code(jit);
+}
+
+#else
+
+bool jit_compile(Chunk* chunk, const char* name, JitCode* jit) {
+    (void)chunk;
+    (void)name;
+    init_jit_code(jit);
+    return false;
+}
+
+void free_jit_code(JitCode* jit) {
+    init_jit_code(jit);
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef allo_jit_h
+#define allo_jit_h
+
+#include "chunk.h"
+#include "value.h"
+
+// Native code for one chunk. Called with the stack top, the base of the
+// chunk's slots and its constants; returns an InterpretResult.
+typedef int (*JitFunction)(Value* stackTop, Value* slots, Value* constants);
+
+typedef struct {
+    JitFunction function;
+    void* code;
+    size_t size;
+} JitCode;
+
+void init_jit_code(JitCode* jit);
+void free_jit_code(JitCode* jit);
+
+// Translates `chunk` to x86-64 code. Fails on other platforms, so callers fall
+// back to run(). The code refers to the chunk's bytecode for error lines, so
+// the chunk has to outlive it.
+bool jit_compile(Chunk* chunk, const char* name, JitCode* jit);
+
+#endif //allo_jit_h
@@ -0,0 +1,310 @@
+#include "list.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "memory.h"
+#include "virtual_machine.h"
+
+#if defined(__GNUC__)
+// Two doubles: one SSE2 or NEON register, which every 64-bit target of GCC
+// and Clang has. Wider vectors than the target's registers get split through
+// memory, which is slower than not vectorizing at all.
+typedef double Lanes __attribute__((vector_size(2 * sizeof(double))));
+typedef int64_t LaneMask __attribute__((vector_size(2 * sizeof(int64_t))));
+#define LANES 2
+// List storage only has the allocator's alignment.
+#define LOAD_LANES(lanes, numbers) memcpy(&(lanes), (numbers), sizeof(Lanes))
+#endif
+
+// The kernels behind the builtins on packed lists. Each keeps several
+// accumulators going so an add doesn't wait on the one before, then finishes
+// the elements that don't fill a round one at a time. Unpacked lists are
+// added up in the same order by the *_values() versions, so a result never
+// depends on how the list is stored.
+
+static double sum_numbers(const double* numbers, int count) {
+    double sum = 0;
+    int i = 0;
+#ifdef LANES
+    Lanes a = {0, 0}, b = {0, 0}, c = {0, 0}, d = {0, 0};
+    for (; i + 4 * LANES <= count; i += 4 * LANES) {
+        Lanes w, x, y, z;
+        LOAD_LANES(w, numbers + i);
+        LOAD_LANES(x, numbers + i + LANES);
+        LOAD_LANES(y, numbers + i + 2 * LANES);
+        LOAD_LANES(z, numbers + i + 3 * LANES);
+        a += w;
+        b += x;
+        c += y;
+        d += z;
+    }
+    a = (a + b) + (c + d);
+    sum = a[0] + a[1];
+#endif
+    for (; i < count; i++) sum += numbers[i];
+    return sum;
+}
+
+static double dot_numbers(const double* left, const double* right, int count) {
+    double dot = 0;
+    int i = 0;
+#ifdef LANES
+    Lanes a = {0, 0}, b = {0, 0}, c = {0, 0}, d = {0, 0};
+    for (; i + 4 * LANES <= count; i += 4 * LANES) {
+        Lanes w, x, y, z, ww, xx, yy, zz;
+        LOAD_LANES(w, left + i);
+        LOAD_LANES(x, left + i + LANES);
+        LOAD_LANES(y, left + i + 2 * LANES);
+        LOAD_LANES(z, left + i + 3 * LANES);
+        LOAD_LANES(ww, right + i);
+        LOAD_LANES(xx, right + i + LANES);
+        LOAD_LANES(yy, right + i + 2 * LANES);
+        LOAD_LANES(zz, right + i + 3 * LANES);
+        a += w * ww;
+        b += x * xx;
+        c += y * yy;
+        d += z * zz;
+    }
+    a = (a + b) + (c + d);
+    dot = a[0] + a[1];
+#endif
+    for (; i < count; i++) dot += left[i] * right[i];
+    return dot;
+}
+
+#ifdef LANES
+// Combines a round's worth of partial sums, one per element of a round, the
+// way the kernels combine their vector accumulators.
+static double fold_lanes(const double* partial) {
+    double sum = 0;
+    for (int lane = 0; lane < LANES; lane++) {
+        double combined = (partial[lane] + partial[LANES + lane]) +
+                          (partial[2 * LANES + lane] + partial[3 * LANES + lane]);
+        sum = lane == 0 ? combined : sum + combined;
+    }
+    return sum;
+}
+#endif
+
+static double sum_values(const Value* values, int count) {
+    double sum = 0;
+    int i = 0;
+#ifdef LANES
+    double partial[4 * LANES] = {0};
+    for (; i + 4 * LANES <= count; i += 4 * LANES) {
+        for (int k = 0; k < 4 * LANES; k++) partial[k] += AS_NUMBER(values[i + k]);
+    }
+    sum = fold_lanes(partial);
+#endif
+    for (; i < count; i++) sum += AS_NUMBER(values[i]);
+    return sum;
+}
+
+// Either list may be packed; the caller has checked every element is a number.
+static double dot_values(ObjList* left, ObjList* right) {
+#define ELEMENT(list, index) \
+    ((list)->packed ? (list)->as.numbers[index] : AS_NUMBER((list)->as.values[index]))
+    double dot = 0;
+    int i = 0;
+    int count = left->count;
+#ifdef LANES
+    double partial[4 * LANES] = {0};
+    for (; i + 4 * LANES <= count; i += 4 * LANES) {
+        for (int k = 0; k < 4 * LANES; k++) {
+            partial[k] += ELEMENT(left, i + k) * ELEMENT(right, i + k);
+        }
+    }
+    dot = fold_lanes(partial);
+#endif
+    for (; i < count; i++) dot += ELEMENT(left, i) * ELEMENT(right, i);
+    return dot;
+#undef ELEMENT
+}
+
+// For a non-empty list. Each lane keeps the best it has seen, chosen with a
+// mask since C has no vector ?: operator.
+#ifdef LANES
+#define EXTREME_NUMBERS(name, better)                                           \
+    static double name(const double* numbers, int count) {                      \
+        double best = numbers[0];                                               \
+        int i = 1;                                                              \
+        if (count >= 2 * LANES) {                                               \
+            Lanes a, b;                                                         \
+            LOAD_LANES(a, numbers);                                             \
+            LOAD_LANES(b, numbers + LANES);                                     \
+            for (i = 2 * LANES; i + 2 * LANES <= count; i += 2 * LANES) {       \
+                Lanes x, y;                                                     \
+                LOAD_LANES(x, numbers + i);                                     \
+                LOAD_LANES(y, numbers + i + LANES);                             \
+                LaneMask takeX = (LaneMask)(x better a);                        \
+                LaneMask takeY = (LaneMask)(y better b);                        \
+                a = (Lanes)(((LaneMask)x & takeX) | ((LaneMask)a & ~takeX));    \
+                b = (Lanes)(((LaneMask)y & takeY) | ((LaneMask)b & ~takeY));    \
+            }                                                                   \
+            best = a[0];                                                        \
+            for (int lane = 1; lane < LANES; lane++) {                          \
+                if (a[lane] better best) best = a[lane];                        \
+            }                                                                   \
+            for (int lane = 0; lane < LANES; lane++) {                          \
+                if (b[lane] better best) best = b[lane];                        \
+            }                                                                   \
+        }                                                                       \
+        for (; i < count; i++) {                                                \
+            if (numbers[i] better best) best = numbers[i];                      \
+        }                                                                       \
+        return best;                                                            \
+    }
+#else
+#define EXTREME_NUMBERS(name, better)                                           \
+    static double name(const double* numbers, int count) {                      \
+        double best = numbers[0];                                               \
+        for (int i = 1; i < count; i++) {                                       \
+            if (numbers[i] better best) best = numbers[i];                      \
+        }                                                                       \
+        return best;                                                            \
+    }
+#endif
+
+EXTREME_NUMBERS(min_numbers, <)
+EXTREME_NUMBERS(max_numbers, >)
+
+#undef EXTREME_NUMBERS
+
+// Moves a packed list's numbers into Values, for good.
+static void unpack(ObjList* list) {
+    Value* values = ALLOCATE(Value, list->capacity);
+    for (int i = 0; i < list->count; i++) values[i] = NUMBER_VAL(list->as.numbers[i]);
+
+    FREE_ARRAY(double, list->as.numbers, list->capacity);
+    list->as.values = values;
+    list->packed = false;
+}
+
+static void grow(ObjList* list) {
+    int capacity = GROW_CAPACITY(list->capacity);
+    if (list->packed) {
+        list->as.numbers = GROW_ARRAY(double, list->as.numbers, list->capacity, capacity);
+    } else {
+        list->as.values = GROW_ARRAY(Value, list->as.values, list->capacity, capacity);
+    }
+    list->capacity = capacity;
+}
+
+const char* list_append(Value list, Value value) {
+    if (!IS_LIST(list)) return "append() needs a list.";
+
+    ObjList* elements = AS_LIST(list);
+    if (elements->packed && !IS_NUMBER(value)) unpack(elements);
+    if (elements->count == elements->capacity) grow(elements);
+
+    if (elements->packed) {
+        elements->as.numbers[elements->count++] = AS_NUMBER(value);
+    } else {
+        elements->as.values[elements->count++] = value;
+    }
+    return NULL;
+}
+
+const char* list_set(Value list, Value index, Value value) {
+    if (!IS_LIST(list)) return index_error(list, index);
+    ObjList* elements = AS_LIST(list);
+    int slot = list_slot(elements, index);
+    if (slot == -1) return index_error(list, index);
+
+    if (elements->packed) {
+        if (IS_NUMBER(value)) {
+            elements->as.numbers[slot] = AS_NUMBER(value);
+            return NULL;
+        }
+        unpack(elements);
+    }
+    elements->as.values[slot] = value;
+    return NULL;
+}
+
+const char* index_error(Value list, Value index) {
+    if (!IS_LIST(list)) return "Only lists and maps can be indexed.";
+    if (!IS_NUMBER(index)) return "List index must be a number.";
+    if (AS_NUMBER(index) != floor(AS_NUMBER(index))) return "List index must be a whole number.";
+    return "List index out of range.";
+}
+
+const char* builtin_len(Value value, Value* result) {
+    if (IS_LIST(value)) {
+        *result = NUMBER_VAL(AS_LIST(value)->count);
+    } else if (IS_MAP(value)) {
+        *result = NUMBER_VAL(AS_MAP(value)->table.count);
+    } else if (IS_TEXT(value)) {
+        *result = NUMBER_VAL(text_length(value));
+    } else {
+        return "len() needs a list, a map or a string.";
+    }
+    return NULL;
+}
+
+// Unpacked lists can hold only numbers again after assignments; they take
+// the slow way, checking each element first.
+
+const char* builtin_sum(Value list, Value* result) {
+    poll_interrupt();
+    if (!IS_LIST(list)) return "sum() needs a list of numbers.";
+    ObjList* elements = AS_LIST(list);
+    if (elements->packed) {
+        *result = NUMBER_VAL(sum_numbers(elements->as.numbers, elements->count));
+        return NULL;
+    }
+
+    for (int i = 0; i < elements->count; i++) {
+        if (!IS_NUMBER(elements->as.values[i])) return "sum() needs a list of numbers.";
+    }
+    *result = NUMBER_VAL(sum_values(elements->as.values, elements->count));
+    return NULL;
+}
+
+#define BUILTIN_EXTREME(name, kernel, better, message)                          \
+    const char* name(Value list, Value* result) {                               \
+        poll_interrupt();                                                       \
+        if (!IS_LIST(list) || AS_LIST(list)->count == 0) return message;        \
+        ObjList* elements = AS_LIST(list);                                      \
+        if (elements->packed) {                                                 \
+            *result = NUMBER_VAL(kernel(elements->as.numbers, elements->count)); \
+            return NULL;                                                        \
+        }                                                                       \
+                                                                                \
+        Value* values = elements->as.values;                                    \
+        if (!IS_NUMBER(values[0])) return message;                              \
+        double best = AS_NUMBER(values[0]);                                     \
+        for (int i = 1; i < elements->count; i++) {                             \
+            if (!IS_NUMBER(values[i])) return message;                          \
+            if (AS_NUMBER(values[i]) better best) best = AS_NUMBER(values[i]);  \
+        }                                                                       \
+        *result = NUMBER_VAL(best);                                             \
+        return NULL;                                                            \
+    }
+
+BUILTIN_EXTREME(builtin_min, min_numbers, <, "min() needs a non-empty list of numbers.")
+BUILTIN_EXTREME(builtin_max, max_numbers, >, "max() needs a non-empty list of numbers.")
+
+#undef BUILTIN_EXTREME
+
+const char* builtin_dot(Value a, Value b, Value* result) {
+    static const char* const message = "dot() needs two lists of numbers of the same length.";
+    poll_interrupt();
+    if (!IS_LIST(a) || !IS_LIST(b)) return message;
+    ObjList* left = AS_LIST(a);
+    ObjList* right = AS_LIST(b);
+    if (left->count != right->count) return message;
+
+    if (left->packed && right->packed) {
+        *result = NUMBER_VAL(dot_numbers(left->as.numbers, right->as.numbers, left->count));
+        return NULL;
+    }
+
+    for (int i = 0; i < left->count; i++) {
+        if (!left->packed && !IS_NUMBER(left->as.values[i])) return message;
+        if (!right->packed && !IS_NUMBER(right->as.values[i])) return message;
+    }
+    *result = NUMBER_VAL(dot_values(left, right));
+    return NULL;
+}
@@ -0,0 +1,45 @@
+#ifndef allo_list_h
+#define allo_list_h
+
+#include "object.h"
+
+// What the list instructions do, shared by every backend. Each returns NULL
+// once done, or the message of the runtime error to raise instead.
+
+const char* list_append(Value list, Value value);
+const char* list_set(Value list, Value index, Value value);
+const char* index_error(Value list, Value index);
+
+// The element `index` names, or -1 when it isn't a whole number in range.
+static inline int list_slot(ObjList* list, Value index) {
+    if (!IS_NUMBER(index)) return -1;
+    double number = AS_NUMBER(index);
+    // Also false for NaN.
+    if (!(number >= 0 && number < list->count)) return -1;
+    int slot = (int)number;
+    return slot == number ? slot : -1;
+}
+
+// Inline so OP_GET_INDEX's common case costs no call.
+static inline const char* list_get(Value list, Value index, Value* result) {
+    if (!IS_LIST(list)) return index_error(list, index);
+    ObjList* elements = AS_LIST(list);
+    int slot = list_slot(elements, index);
+    if (slot == -1) return index_error(list, index);
+
+    *result = elements->packed ? NUMBER_VAL(elements->as.numbers[slot])
+                               : elements->as.values[slot];
+    return NULL;
+}
+
+// The builtins. len() also takes a map or a string. sum() and dot() add in several
+// lanes at once, so their last bits can differ from adding in order, though
+// never between two lists with the same elements; min() and max() of a list
+// holding NaN are unspecified.
+const char* builtin_len(Value value, Value* result);
+const char* builtin_sum(Value list, Value* result);
+const char* builtin_min(Value list, Value* result);
+const char* builtin_max(Value list, Value* result);
+const char* builtin_dot(Value a, Value b, Value* result);
+
+#endif //allo_list_h
@@ -0,0 +1,39 @@
+#include "map.h"
+
+// NaN equals nothing, itself included, so an entry under it could never be
+// read back or deleted.
+static bool is_nan_key(Value key) {
+    return IS_NUMBER(key) && AS_NUMBER(key) != AS_NUMBER(key);
+}
+
+// Views hash by pointer like other objects, so one is looked up as the
+// interned string with its chars, which hashes and compares like any other.
+static Value table_key(Value key) {
+    return IS_VIEW(key) ? OBJ_VAL(text_to_string(key)) : key;
+}
+
+const char* map_add_entry(Value map, Value key, Value value) {
+    if (!IS_MAP(map)) return "Only maps have entries.";
+    if (is_nan_key(key)) return "Map keys can't be NaN.";
+
+    value_table_set(&AS_MAP(map)->table, table_key(key), value);
+    return NULL;
+}
+
+const char* map_get(Value map, Value key, Value* result) {
+    if (!IS_MAP(map)) return "Only maps have entries.";
+    if (!value_table_get(&AS_MAP(map)->table, table_key(key), result)) return "Key not found in map.";
+    return NULL;
+}
+
+const char* map_get_default(Value map, Value key, Value fallback, Value* result) {
+    if (!IS_MAP(map)) return "get() needs a map.";
+    if (!value_table_get(&AS_MAP(map)->table, table_key(key), result)) *result = fallback;
+    return NULL;
+}
+
+const char* map_delete(Value map, Value key, Value* result) {
+    if (!IS_MAP(map)) return "delete() needs a map.";
+    *result = BOOL_VAL(value_table_delete(&AS_MAP(map)->table, table_key(key)));
+    return NULL;
+}
@@ -0,0 +1,30 @@
+#ifndef allo_map_h
+#define allo_map_h
+
+#include "list.h"
+#include "object.h"
+
+// What the map instructions do, shared by every backend like the list
+// helpers: each returns NULL once done, or the message of the runtime error
+// to raise instead.
+
+const char* map_add_entry(Value map, Value key, Value value);
+const char* map_get(Value map, Value key, Value* result);
+// get(): `fallback` when the key is missing.
+const char* map_get_default(Value map, Value key, Value fallback, Value* result);
+// delete(): whether the key was there.
+const char* map_delete(Value map, Value key, Value* result);
+
+// xs[i] and m[k]. Anything that isn't a map goes to the list helpers, which
+// report what is neither.
+static inline const char* index_get(Value container, Value index, Value* result) {
+    if (IS_MAP(container)) return map_get(container, index, result);
+    return list_get(container, index, result);
+}
+
+static inline const char* index_set(Value container, Value index, Value value) {
+    if (IS_MAP(container)) return map_add_entry(container, index, value);
+    return list_set(container, index, value);
+}
+
+#endif //allo_map_h
@@ -1,5 +1,6 @@
 #include "memory.h"
 
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -7,26 +8,60 @@
 #include "value.h"
 #include "virtual_machine.h"
 
-void* reallocate(void* pointer, size_t oldSize,size_t newSize) {
-    if (newSize == 0) {
-        free(pointer);
-        pointer = NULL;
+void* try_reallocate(void* pointer, size_t oldSize, size_t newSize) {
+    Allocator* allocator = &vm.allocator;
+    bool libc = allocator->realloc == NULL;
 
+    if (newSize == 0) {
+        if (pointer == NULL) return NULL;
+        if (libc) {
+            free(pointer);
+        } else {
+            allocator->free(allocator->user, pointer, oldSize);
+        }
+        vm.metrics.bytesFreed += oldSize;
+        vm.memoryUsed -= oldSize < vm.memoryUsed ? oldSize : vm.memoryUsed;
         return NULL;
     }
 
-    void* result = realloc(pointer, newSize);
-
+    if (newSize > oldSize && vm.memoryLimit != 0 &&
+        newSize - oldSize > vm.memoryLimit - vm.memoryUsed) {
+        return NULL;
+    }
 
-    if (result == NULL) {
-        printf("[memory] Ran into error while (re)allocating memory\n");
-        exit(OUT_OF_MEMORY_CODE);
+    void* result;
+    if (libc) {
+        result = realloc(pointer, newSize);
+    } else if (pointer == NULL) {
+        result = allocator->alloc(allocator->user, newSize);
+    } else {
+        result = allocator->realloc(allocator->user, pointer, oldSize, newSize);
     }
+    if (result == NULL) return NULL;
 
+    if (newSize > oldSize) {
+        vm.metrics.bytesAllocated += newSize - oldSize;
+        vm.memoryUsed += newSize - oldSize;
+    } else {
+        vm.metrics.bytesFreed += oldSize - newSize;
+        vm.memoryUsed -= oldSize - newSize;
+    }
+    return result;
+}
 
+void* reallocate(void* pointer, size_t oldSize,size_t newSize) {
+    void* result = try_reallocate(pointer, oldSize, newSize);
+    if (result == NULL && newSize != 0) out_of_memory();
     return result;
 }
 
+_Noreturn void out_of_memory() {
+    if (vm.recover != NULL) longjmp(*vm.recover, 1);
+
+    printf("[memory] Ran into error while (re)allocating memory\n");
+    exit(OUT_OF_MEMORY_CODE);
+}
+
 static void free_object(Obj* obj) {
     switch (obj->type) {
         case OBJ_STRING:
@@ -34,11 +69,33 @@ static void free_object(Obj* obj) {
             FREE_ARRAY(char, string->chars, string->length + 1);
             FREE(ObjString, obj);
             break;
+        case OBJ_LIST: {
+            ObjList* list = (ObjList*)obj;
+            if (list->packed) {
+                FREE_ARRAY(double, list->as.numbers, list->capacity);
+            } else {
+                FREE_ARRAY(Value, list->as.values, list->capacity);
+            }
+            FREE(ObjList, obj);
+            break;
+        }
+        case OBJ_MAP:
+            free_value_table(&((ObjMap*)obj)->table);
+            FREE(ObjMap, obj);
+            break;
+        case OBJ_VIEW:
+            // The parent is freed on its own.
+            FREE(ObjView, obj);
+            break;
     }
 }
 
 void free_objects() {
-    Obj* object = vm.objects;
+    free_object_list(vm.objects);
+}
+
+void free_object_list(Obj* objects) {
+    Obj* object = objects;
     while (object != NULL) {
         Obj* next = object->next;
         free_object(object);
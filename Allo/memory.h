@@ -1,7 +1,11 @@
 #ifndef allo_memory_h
 #define allo_memory_h
 
+#include "allo.h"
 #include "common.h"
+#include "value.h"
+
+typedef AlloAllocator Allocator;
 
 #define GROW_CAPACITY(capacity) \
     ((capacity < 8 ? 8 : (capacity) * 2))
@@ -18,8 +22,18 @@
 
 #define FREE(type, pointer) reallocate(pointer, sizeof(type), 0)
 
+// Allocates, resizes or (newSize 0) frees through vm.allocator, counting the
+// bytes against vm.memoryLimit. Never returns NULL for newSize > 0: it calls
+// out_of_memory() instead.
 void* reallocate(void* pointer, size_t oldSize,size_t newSize);
+// Like reallocate(), but returns NULL when out of memory, for callers with
+// something to clean up first.
+void* try_reallocate(void* pointer, size_t oldSize, size_t newSize);
+// Unwinds to vm.recover, or exits with OUT_OF_MEMORY_CODE when nothing set one.
+_Noreturn void out_of_memory();
+
 void free_objects();
+void free_object_list(Obj* objects);
 
 
 #endif //allo_memory_h
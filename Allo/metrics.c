@@ -0,0 +1,42 @@
+#include "metrics.h"
+
+#include <signal.h>
+
+static volatile sig_atomic_t dumpRequested = 0;
+
+void write_metrics_json(const Metrics* metrics, FILE* out) {
+    fprintf(out, "{\"instructions\":%llu,\"strings_created\":%llu,\"strings_interned\":%llu,"
+                 "\"table_lookups\":%llu,\"table_resizes\":%llu,\"table_probe_average\":%.3f,"
+                 "\"table_probe_max\":%llu,\"bytes_allocated\":%llu,\"bytes_freed\":%llu}\n",
+            (unsigned long long)metrics->instructions,
+            (unsigned long long)metrics->stringsCreated,
+            (unsigned long long)metrics->stringsInterned,
+            (unsigned long long)metrics->tableLookups,
+            (unsigned long long)metrics->tableResizes,
+            metrics->averageProbeLength,
+            (unsigned long long)metrics->maxProbeLength,
+            (unsigned long long)metrics->bytesAllocated,
+            (unsigned long long)metrics->bytesFreed);
+    fflush(out);
+}
+
+#ifdef SIGUSR1
+// Writing from the handler itself isn't async-signal-safe. Plain C signal()
+// may reset the handler on delivery, so it puts itself back.
+static void request_dump(int number) {
+    signal(number, request_dump);
+    dumpRequested = 1;
+}
+#endif
+
+void dump_metrics_on_signal() {
+#ifdef SIGUSR1
+    signal(SIGUSR1, request_dump);
+#endif
+}
+
+bool metrics_dump_requested() {
+    if (!dumpRequested) return false;
+    dumpRequested = 0;
+    return true;
+}
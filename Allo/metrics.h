@@ -0,0 +1,34 @@
+#ifndef allo_metrics_h
+#define allo_metrics_h
+
+#include <stdio.h>
+
+#include "common.h"
+
+// Counters every VM keeps in all builds, cheap enough to leave on in
+// production. Read them with get_metrics().
+typedef struct {
+    uint64_t instructions;      // executed by the stack and register interpreters
+    uint64_t stringsCreated;    // copy_string()/take_string() calls that allocated
+    uint64_t stringsInterned;   // ones answered by an already interned string
+    uint64_t tableLookups;
+    uint64_t tableResizes;
+    // Worked out by get_metrics() from the VM's live tables rather than
+    // counted on every lookup: how many entries find_entry() looks at to reach
+    // each key, on average and at most.
+    double averageProbeLength;
+    uint64_t maxProbeLength;
+    uint64_t bytesAllocated;    // growth passed through reallocate()
+    uint64_t bytesFreed;
+} Metrics;
+
+// One JSON object on a single line.
+void write_metrics_json(const Metrics* metrics, FILE* out);
+
+// After this, SIGUSR1 asks for a dump, which the VM writes to stderr when the
+// run in progress finishes. A no-op where there is no SIGUSR1.
+void dump_metrics_on_signal();
+// Whether SIGUSR1 arrived since the last call.
+bool metrics_dump_requested();
+
+#endif //allo_metrics_h
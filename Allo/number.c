@@ -0,0 +1,362 @@
+#include "number.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+
+// Grisu2 (Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+// with Integers"): a 64-bit "do-it-yourself" float is scaled by a cached power
+// of ten so the digits can be generated with integer arithmetic only.
+
+typedef struct {
+    uint64_t f;
+    int e;
+} DiyFp;
+
+#define DP_SIGNIFICAND_MASK UINT64_C(0x000FFFFFFFFFFFFF)
+#define DP_HIDDEN_BIT UINT64_C(0x0010000000000000)
+#define DP_EXPONENT_BIAS 1075
+
+// Normalized 10^k for k = -348, -340, ..., 340.
+static const uint64_t cachedPowersF[] = {
+    UINT64_C(0xfa8fd5a0081c0288), UINT64_C(0xbaaee17fa23ebf76), UINT64_C(0x8b16fb203055ac76), UINT64_C(0xcf42894a5dce35ea),
+    UINT64_C(0x9a6bb0aa55653b2d), UINT64_C(0xe61acf033d1a45df), UINT64_C(0xab70fe17c79ac6ca), UINT64_C(0xff77b1fcbebcdc4f),
+    UINT64_C(0xbe5691ef416bd60c), UINT64_C(0x8dd01fad907ffc3c), UINT64_C(0xd3515c2831559a83), UINT64_C(0x9d71ac8fada6c9b5),
+    UINT64_C(0xea9c227723ee8bcb), UINT64_C(0xaecc49914078536d), UINT64_C(0x823c12795db6ce57), UINT64_C(0xc21094364dfb5637),
+    UINT64_C(0x9096ea6f3848984f), UINT64_C(0xd77485cb25823ac7), UINT64_C(0xa086cfcd97bf97f4), UINT64_C(0xef340a98172aace5),
+    UINT64_C(0xb23867fb2a35b28e), UINT64_C(0x84c8d4dfd2c63f3b), UINT64_C(0xc5dd44271ad3cdba), UINT64_C(0x936b9fcebb25c996),
+    UINT64_C(0xdbac6c247d62a584), UINT64_C(0xa3ab66580d5fdaf6), UINT64_C(0xf3e2f893dec3f126), UINT64_C(0xb5b5ada8aaff80b8),
+    UINT64_C(0x87625f056c7c4a8b), UINT64_C(0xc9bcff6034c13053), UINT64_C(0x964e858c91ba2655), UINT64_C(0xdff9772470297ebd),
+    UINT64_C(0xa6dfbd9fb8e5b88f), UINT64_C(0xf8a95fcf88747d94), UINT64_C(0xb94470938fa89bcf), UINT64_C(0x8a08f0f8bf0f156b),
+    UINT64_C(0xcdb02555653131b6), UINT64_C(0x993fe2c6d07b7fac), UINT64_C(0xe45c10c42a2b3b06), UINT64_C(0xaa242499697392d3),
+    UINT64_C(0xfd87b5f28300ca0e), UINT64_C(0xbce5086492111aeb), UINT64_C(0x8cbccc096f5088cc), UINT64_C(0xd1b71758e219652c),
+    UINT64_C(0x9c40000000000000), UINT64_C(0xe8d4a51000000000), UINT64_C(0xad78ebc5ac620000), UINT64_C(0x813f3978f8940984),
+    UINT64_C(0xc097ce7bc90715b3), UINT64_C(0x8f7e32ce7bea5c70), UINT64_C(0xd5d238a4abe98068), UINT64_C(0x9f4f2726179a2245),
+    UINT64_C(0xed63a231d4c4fb27), UINT64_C(0xb0de65388cc8ada8), UINT64_C(0x83c7088e1aab65db), UINT64_C(0xc45d1df942711d9a),
+    UINT64_C(0x924d692ca61be758), UINT64_C(0xda01ee641a708dea), UINT64_C(0xa26da3999aef774a), UINT64_C(0xf209787bb47d6b85),
+    UINT64_C(0xb454e4a179dd1877), UINT64_C(0x865b86925b9bc5c2), UINT64_C(0xc83553c5c8965d3d), UINT64_C(0x952ab45cfa97a0b3),
+    UINT64_C(0xde469fbd99a05fe3), UINT64_C(0xa59bc234db398c25), UINT64_C(0xf6c69a72a3989f5c), UINT64_C(0xb7dcbf5354e9bece),
+    UINT64_C(0x88fcf317f22241e2), UINT64_C(0xcc20ce9bd35c78a5), UINT64_C(0x98165af37b2153df), UINT64_C(0xe2a0b5dc971f303a),
+    UINT64_C(0xa8d9d1535ce3b396), UINT64_C(0xfb9b7cd9a4a7443c), UINT64_C(0xbb764c4ca7a44410), UINT64_C(0x8bab8eefb6409c1a),
+    UINT64_C(0xd01fef10a657842c), UINT64_C(0x9b10a4e5e9913129), UINT64_C(0xe7109bfba19c0c9d), UINT64_C(0xac2820d9623bf429),
+    UINT64_C(0x80444b5e7aa7cf85), UINT64_C(0xbf21e44003acdd2d), UINT64_C(0x8e679c2f5e44ff8f), UINT64_C(0xd433179d9c8cb841),
+    UINT64_C(0x9e19db92b4e31ba9), UINT64_C(0xeb96bf6ebadf77d9), UINT64_C(0xaf87023b9bf0ee6b),
+};
+
+static const int16_t cachedPowersE[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const uint64_t powersOf10[] = {
+    UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000), UINT64_C(10000),
+    UINT64_C(100000), UINT64_C(1000000), UINT64_C(10000000), UINT64_C(100000000),
+    UINT64_C(1000000000), UINT64_C(10000000000), UINT64_C(100000000000),
+    UINT64_C(1000000000000), UINT64_C(10000000000000), UINT64_C(100000000000000),
+    UINT64_C(1000000000000000), UINT64_C(10000000000000000), UINT64_C(100000000000000000),
+    UINT64_C(1000000000000000000), UINT64_C(10000000000000000000)
+};
+
+static DiyFp diy_fp(uint64_t f, int e) {
+    DiyFp fp = {f, e};
+    return fp;
+}
+
+static DiyFp diy_fp_from_double(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    int biasedExponent = (int)((bits >> 52) & 0x7FF);
+    uint64_t significand = bits & DP_SIGNIFICAND_MASK;
+    if (biasedExponent != 0) {
+        return diy_fp(significand + DP_HIDDEN_BIT, biasedExponent - DP_EXPONENT_BIAS);
+    }
+    return diy_fp(significand, 1 - DP_EXPONENT_BIAS);
+}
+
+static DiyFp diy_fp_multiply(DiyFp x, DiyFp y) {
+    const uint64_t mask32 = 0xFFFFFFFF;
+    uint64_t a = x.f >> 32, b = x.f & mask32;
+    uint64_t c = y.f >> 32, d = y.f & mask32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+
+    uint64_t middle = (bd >> 32) + (ad & mask32) + (bc & mask32);
+    middle += UINT64_C(1) << 31; // round
+    return diy_fp(ac + (ad >> 32) + (bc >> 32) + (middle >> 32), x.e + y.e + 64);
+}
+
+static DiyFp diy_fp_normalize(DiyFp x) {
+    while (!(x.f & (UINT64_C(1) << 63))) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+// The boundaries halfway to the neighbouring doubles, sharing plus's exponent.
+static void normalized_boundaries(DiyFp v, DiyFp* minus, DiyFp* plus) {
+    DiyFp upper = diy_fp((v.f << 1) + 1, v.e - 1);
+    while (!(upper.f & (DP_HIDDEN_BIT << 1))) {
+        upper.f <<= 1;
+        upper.e--;
+    }
+    upper.f <<= 64 - 52 - 2;
+    upper.e -= 64 - 52 - 2;
+
+    DiyFp lower = v.f == DP_HIDDEN_BIT
+        ? diy_fp((v.f << 2) - 1, v.e - 2)
+        : diy_fp((v.f << 1) - 1, v.e - 1);
+    lower.f <<= lower.e - upper.e;
+    lower.e = upper.e;
+
+    *minus = lower;
+    *plus = upper;
+}
+
+static DiyFp cached_power(int e, int* k) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int rounded = (int)dk;
+    if (dk - rounded > 0.0) rounded++;
+
+    unsigned index = (unsigned)((rounded >> 3) + 1);
+    *k = -(-348 + (int)(index * 8));
+    return diy_fp(cachedPowersF[index], cachedPowersE[index]);
+}
+
+static int count_decimal_digits(uint32_t n) {
+    int digits = 1;
+    while (digits < 10 && n >= powersOf10[digits]) digits++;
+    return digits;
+}
+
+static void grisu_round(char* buffer, int length, uint64_t delta, uint64_t rest,
+                        uint64_t tenKappa, uint64_t distance) {
+    while (rest < distance && delta - rest >= tenKappa &&
+           (rest + tenKappa < distance || distance - rest > rest + tenKappa - distance)) {
+        buffer[length - 1]--;
+        rest += tenKappa;
+    }
+}
+
+static int generate_digits(DiyFp w, DiyFp upper, uint64_t delta, char* buffer, int* k) {
+    DiyFp one = diy_fp(UINT64_C(1) << -upper.e, upper.e);
+    uint64_t distance = upper.f - w.f;
+    uint32_t integral = (uint32_t)(upper.f >> -one.e);
+    uint64_t fractional = upper.f & (one.f - 1);
+    int kappa = count_decimal_digits(integral);
+    int length = 0;
+
+    while (kappa > 0) {
+        uint32_t divisor = (uint32_t)powersOf10[kappa - 1];
+        uint32_t digit = integral / divisor;
+        integral %= divisor;
+        if (digit || length) buffer[length++] = (char)('0' + digit);
+        kappa--;
+
+        uint64_t rest = ((uint64_t)integral << -one.e) + fractional;
+        if (rest <= delta) {
+            *k += kappa;
+            grisu_round(buffer, length, delta, rest, powersOf10[kappa] << -one.e, distance);
+            return length;
+        }
+    }
+
+    for (;;) {
+        fractional *= 10;
+        delta *= 10;
+        char digit = (char)(fractional >> -one.e);
+        if (digit || length) buffer[length++] = (char)('0' + digit);
+        fractional &= one.f - 1;
+        kappa--;
+
+        if (fractional < delta) {
+            *k += kappa;
+            uint64_t scale = -kappa < 20 ? powersOf10[-kappa] : 0;
+            grisu_round(buffer, length, delta, fractional, one.f, distance * scale);
+            return length;
+        }
+    }
+}
+
+// Shortest digits of a positive finite value; the value is digits * 10^k.
+static int grisu2(double value, char* digits, int* k) {
+    DiyFp v = diy_fp_from_double(value);
+    DiyFp minus, plus;
+    normalized_boundaries(v, &minus, &plus);
+
+    DiyFp power = cached_power(plus.e, k);
+    DiyFp w = diy_fp_multiply(diy_fp_normalize(v), power);
+    DiyFp upper = diy_fp_multiply(plus, power);
+    DiyFp lower = diy_fp_multiply(minus, power);
+    lower.f++;
+    upper.f--;
+
+    return generate_digits(w, upper, upper.f - lower.f, digits, k);
+}
+
+static int write_exponent(int exponent, char* buffer) {
+    int length = 0;
+    buffer[length++] = 'e';
+    buffer[length++] = exponent < 0 ? '-' : '+';
+    if (exponent < 0) exponent = -exponent;
+
+    if (exponent >= 100) buffer[length++] = (char)('0' + exponent / 100);
+    buffer[length++] = (char)('0' + exponent / 10 % 10);
+    buffer[length++] = (char)('0' + exponent % 10);
+    return length;
+}
+
+static int write_scientific(const char* digits, int count, int exponent, char* buffer) {
+    int length = 0;
+    buffer[length++] = digits[0];
+    if (count > 1) {
+        buffer[length++] = '.';
+        memcpy(buffer + length, digits + 1, count - 1);
+        length += count - 1;
+    }
+    return length + write_exponent(exponent, buffer + length);
+}
+
+// digits * 10^exponent in the layout %g uses: plain for exponents from -4 up,
+// scientific with at least two exponent digits below that. Non-integral
+// doubles never have an exponent above 15, so plain notation always fits.
+static int write_decimal(const char* digits, int count, int exponent, char* buffer) {
+    int length = 0;
+
+    if (exponent < -4) return write_scientific(digits, count, exponent, buffer);
+
+    if (exponent < 0) {
+        buffer[length++] = '0';
+        buffer[length++] = '.';
+        for (int i = -1; i > exponent; i--) buffer[length++] = '0';
+        memcpy(buffer + length, digits, count);
+        return length + count;
+    }
+
+    memcpy(buffer, digits, exponent + 1);
+    length = exponent + 1;
+    buffer[length++] = '.';
+    memcpy(buffer + length, digits + exponent + 1, count - exponent - 1);
+    return length + count - exponent - 1;
+}
+
+// Integral values of 1e6 and up, which %g rounds to six significant digits
+// (ties to even) and prints in scientific notation.
+static int write_rounded_integer(uint64_t n, char* buffer) {
+    char digits[6];
+    int count = 0;
+    while (count < 20 && n >= powersOf10[count]) count++;
+
+    uint64_t divisor = powersOf10[count - 6];
+    uint64_t quotient = n / divisor;
+    uint64_t remainder = n % divisor;
+    uint64_t half = divisor / 2;
+    if (remainder > half || (remainder == half && (quotient & 1))) quotient++;
+
+    int exponent = count - 1;
+    if (quotient == 1000000) {
+        quotient = 100000;
+        exponent++;
+    }
+
+    for (int i = 5; i >= 0; i--) {
+        digits[i] = (char)('0' + quotient % 10);
+        quotient /= 10;
+    }
+
+    int significant = 6;
+    while (significant > 1 && digits[significant - 1] == '0') significant--;
+    return write_scientific(digits, significant, exponent, buffer);
+}
+
+int format_number(double value, char* buffer) {
+    if (!isfinite(value) || fabs(value) >= 9.2e18) {
+        return snprintf(buffer, NUMBER_BUFFER_SIZE, "%g", value);
+    }
+
+    int length = 0;
+    if (signbit(value)) {
+        buffer[length++] = '-';
+        value = -value;
+    }
+
+    if (value == floor(value)) {
+        uint64_t n = (uint64_t)value;
+        if (n >= 1000000) return length + write_rounded_integer(n, buffer + length);
+
+        char digits[8];
+        int count = 0;
+        do {
+            digits[count++] = (char)('0' + n % 10);
+            n /= 10;
+        } while (n > 0);
+        while (count > 0) buffer[length++] = digits[--count];
+        return length;
+    }
+
+    char digits[18];
+    int k;
+    int count = grisu2(value, digits, &k);
+    return length + write_decimal(digits, count, count + k - 1, buffer + length);
+}
+
+// Every power of ten a double holds exactly.
+static const double exactPowersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define MAX_EXACT_MANTISSA (UINT64_C(1) << 53)
+#define MAX_MANTISSA_DIGITS 19
+
+static double parse_number_slow(const char* chars, int length) {
+    char buffer[64];
+    char* copy = length < (int)sizeof(buffer) ? buffer : ALLOCATE(char, length + 1);
+    memcpy(copy, chars, length);
+    copy[length] = '\0';
+
+    double value = strtod(copy, NULL);
+
+    if (copy != buffer) FREE_ARRAY(char, copy, length + 1);
+    return value;
+}
+
+double parse_number(const char* chars, int length) {
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int fractionDigits = 0;
+    bool inFraction = false;
+
+    for (int i = 0; i < length; i++) {
+        char c = chars[i];
+        if (c == '.') {
+            inFraction = true;
+            continue;
+        }
+
+        if (mantissa != 0 || c != '0') {
+            if (++digits > MAX_MANTISSA_DIGITS) return parse_number_slow(chars, length);
+        }
+        mantissa = mantissa * 10 + (uint64_t)(c - '0');
+        if (inFraction) fractionDigits++;
+    }
+
+    // Both operands are exact, so the single rounding of the conversion or
+    // the division gives the correctly rounded result (Clinger's fast path).
+    if (fractionDigits == 0) return (double)mantissa;
+    if (mantissa <= MAX_EXACT_MANTISSA && fractionDigits <= 22) {
+        return (double)mantissa / exactPowersOf10[fractionDigits];
+    }
+
+    return parse_number_slow(chars, length);
+}
@@ -0,0 +1,18 @@
+#ifndef allo_number_h
+#define allo_number_h
+
+#include "common.h"
+
+// Longest output of format_number(), e.g. "-2.2250738585072014e-308".
+#define NUMBER_BUFFER_SIZE 32
+
+// Writes the textual form of a number into buffer (not NUL-terminated) and
+// returns its length. Integral values print exactly as printf("%g") does;
+// everything else gets the shortest digits that read back to the same double.
+int format_number(double value, char* buffer);
+
+// Parses a number literal as the scanner produced it (digits with at most one
+// '.'), reading exactly length characters.
+double parse_number(const char* chars, int length);
+
+#endif //allo_number_h
@@ -15,8 +15,7 @@
 (type*)allocate_object(sizeof(type), objectType)
 
 
-static Obj* allocate_object(size_t size, ObjType type) {
-    Obj* object = (Obj*)reallocate(NULL, 0, size);
+static Obj* init_object(Obj* object, ObjType type) {
     object->type = type;
 
     object->next = vm.objects;
@@ -25,8 +24,19 @@ static Obj* allocate_object(size_t size, ObjType type) {
     return object;
 }
 
+static Obj* allocate_object(size_t size, ObjType type) {
+    return init_object((Obj*)reallocate(NULL, 0, size), type);
+}
+
 static ObjString* allocate_string(char* chars, int length, uint32_t hash) {
-    ObjString* string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+    // The string owns chars from here on, so they go if it can't be made.
+    Obj* object = try_reallocate(NULL, 0, sizeof(ObjString));
+    if (object == NULL) {
+        FREE_ARRAY(char, chars, length + 1);
+        out_of_memory();
+    }
+
+    ObjString* string = (ObjString*)init_object(object, OBJ_STRING);
     string->length = length;
     string->chars = chars;
 
@@ -47,13 +57,28 @@ static uint32_t hash_string(const char* key, int length) {
 }
 
 
+static ObjString* find_interned(const char* chars, int length, uint32_t hash) {
+    if (vm.frozenStrings != NULL) {
+        ObjString* frozen = table_find_string(vm.frozenStrings, chars, length, hash);
+        if (frozen != NULL) return frozen;
+    }
+
+    return table_find_string(&vm.strings, chars, length, hash);
+}
+
+
 ObjString * copy_string(const char *chars, int length) {
-    uint32_t hash = hash_string(chars, length);
+    return copy_hashed_string(chars, length, hash_string(chars, length));
+}
 
-    ObjString* interned = table_find_string(&vm.strings, chars, length,
-                                           hash);
-    if (interned != NULL) return interned;
+ObjString* copy_hashed_string(const char* chars, int length, uint32_t hash) {
+    ObjString* interned = find_interned(chars, length, hash);
+    if (interned != NULL) {
+        vm.metrics.stringsInterned++;
+        return interned;
+    }
 
+    vm.metrics.stringsCreated++;
     char* heap_chars = ALLOCATE(char, length + 1);
     memcpy(heap_chars, chars, length);
     heap_chars[length] = '\0';
@@ -63,20 +88,161 @@ ObjString * copy_string(const char *chars, int length) {
 ObjString * take_string(char *chars, int length) {
     uint32_t hash = hash_string(chars, length);
 
-    ObjString* interned = table_find_string(&vm.strings, chars, length,
-                                        hash);
+    ObjString* interned = find_interned(chars, length, hash);
     if (interned != NULL) {
+        vm.metrics.stringsInterned++;
         FREE_ARRAY(char, chars, length + 1);
         return interned;
     }
 
+    vm.metrics.stringsCreated++;
     return allocate_string(chars, length, hash);
 }
 
+ObjList* new_list(int capacity) {
+    ObjList* list = ALLOCATE_OBJ(ObjList, OBJ_LIST);
+    list->packed = true;
+    list->printing = false;
+    list->count = 0;
+    list->capacity = 0;
+    list->as.numbers = NULL;
+
+    if (capacity > 0) {
+        list->as.numbers = ALLOCATE(double, capacity);
+        list->capacity = capacity;
+    }
+    return list;
+}
+
+ObjMap* new_map(int count) {
+    ObjMap* map = ALLOCATE_OBJ(ObjMap, OBJ_MAP);
+    map->printing = false;
+    init_value_table(&map->table);
+    value_table_reserve(&map->table, count);
+    return map;
+}
+
+ObjView* new_view(Value text, int start, int length) {
+    ObjString* parent = IS_STRING(text) ? AS_STRING(text) : AS_VIEW(text)->parent;
+    if (IS_VIEW(text)) start += AS_VIEW(text)->start;
+
+    ObjView* view = ALLOCATE_OBJ(ObjView, OBJ_VIEW);
+    view->parent = parent;
+    view->start = start;
+    view->length = length;
+    return view;
+}
+
+ObjString* text_to_string(Value text) {
+    if (IS_STRING(text)) return AS_STRING(text);
+    return copy_string(text_chars(text), text_length(text));
+}
+
+bool texts_equal(Value a, Value b) {
+    // Strings are interned, so two different ones never have the same chars.
+    if (!IS_TEXT(a) || !IS_TEXT(b) || (IS_STRING(a) && IS_STRING(b))) return false;
+    return text_length(a) == text_length(b) &&
+           memcmp(text_chars(a), text_chars(b), text_length(a)) == 0;
+}
+
+static Value list_element(ObjList* list, int index) {
+    return list->packed ? NUMBER_VAL(list->as.numbers[index]) : list->as.values[index];
+}
+
 void print_object(Value value) {
     switch (OBJ_TYPE(value)) {
         case OBJ_STRING:
             printf("%s", AS_CSTRING(value));
             break;
+        case OBJ_LIST: {
+            ObjList* list = AS_LIST(value);
+            if (list->printing) {
+                printf("[...]");
+                break;
+            }
+            list->printing = true;
+            printf("[");
+            for (int i = 0; i < list->count; i++) {
+                if (i > 0) printf(", ");
+                print_value(list_element(list, i));
+            }
+            printf("]");
+            list->printing = false;
+            break;
+        }
+        case OBJ_MAP: {
+            ObjMap* map = AS_MAP(value);
+            if (map->printing) {
+                printf("{...}");
+                break;
+            }
+            map->printing = true;
+            printf("{");
+            bool first = true;
+            for (int i = 0; i < map->table.capacity; i++) {
+                if (!value_table_holds(&map->table, i)) continue;
+                if (!first) printf(", ");
+                first = false;
+                print_value(map->table.entries[i].key);
+                printf(": ");
+                print_value(map->table.entries[i].value);
+            }
+            printf("}");
+            map->printing = false;
+            break;
+        }
+        case OBJ_VIEW:
+            printf("%.*s", text_length(value), text_chars(value));
+            break;
+    }
+}
+
+void write_object(OutputBuffer* output, Value value) {
+    switch (OBJ_TYPE(value)) {
+        case OBJ_STRING:
+            write_output(output, AS_CSTRING(value), AS_STRING(value)->length);
+            break;
+        case OBJ_LIST: {
+            // A list that contains itself prints as [...] the second time.
+            ObjList* list = AS_LIST(value);
+            if (list->printing) {
+                write_output(output, "[...]", 5);
+                break;
+            }
+            list->printing = true;
+            write_output_char(output, '[');
+            for (int i = 0; i < list->count; i++) {
+                if (i > 0) write_output(output, ", ", 2);
+                write_value(output, list_element(list, i));
+            }
+            write_output_char(output, ']');
+            list->printing = false;
+            break;
+        }
+        case OBJ_MAP: {
+            // Entries come out in table order.
+            ObjMap* map = AS_MAP(value);
+            if (map->printing) {
+                write_output(output, "{...}", 5);
+                break;
+            }
+            map->printing = true;
+            write_output_char(output, '{');
+            bool first = true;
+            for (int i = 0; i < map->table.capacity; i++) {
+                if (!value_table_holds(&map->table, i)) continue;
+                if (!first) write_output(output, ", ", 2);
+                first = false;
+                write_value(output, map->table.entries[i].key);
+                write_output(output, ": ", 2);
+                write_value(output, map->table.entries[i].value);
+            }
+            write_output_char(output, '}');
+            map->printing = false;
+            break;
+        }
+        case OBJ_VIEW:
+            write_output(output, text_chars(value), text_length(value));
+            break;
     }
 }
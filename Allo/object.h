@@ -2,17 +2,29 @@
 #define allo_object_h
 
 #include "common.h"
+#include "table.h"
 #include "value.h"
 
 #define OBJ_TYPE(value)         (AS_OBJ(value)->type)
 
 #define IS_STRING(value)        is_obj_type(value, OBJ_STRING)
+#define IS_LIST(value)          is_obj_type(value, OBJ_LIST)
+#define IS_MAP(value)           is_obj_type(value, OBJ_MAP)
+#define IS_VIEW(value)          is_obj_type(value, OBJ_VIEW)
+// A string or a view of one.
+#define IS_TEXT(value)          (IS_STRING(value) || IS_VIEW(value))
 
 #define AS_STRING(value)        ((ObjString*)AS_OBJ(value))
 #define AS_CSTRING(value)       (((ObjString*)AS_OBJ(value))->chars)
+#define AS_LIST(value)          ((ObjList*)AS_OBJ(value))
+#define AS_MAP(value)           ((ObjMap*)AS_OBJ(value))
+#define AS_VIEW(value)          ((ObjView*)AS_OBJ(value))
 
 typedef enum {
     OBJ_STRING,
+    OBJ_LIST,
+    OBJ_MAP,
+    OBJ_VIEW,
 } ObjType;
 
 
@@ -28,15 +40,73 @@ struct ObjString {
     uint32_t hash;
 };
 
+// Elements are stored as plain doubles for as long as every one is a number,
+// which halves the memory and lets the numeric builtins run over them with
+// SIMD. The first element that isn't a number unpacks the list into Values,
+// and it stays unpacked.
+struct ObjList {
+    Obj obj;
+    bool packed;
+    bool printing;      // set while write_object() is inside it, to stop at cycles
+    int count;
+    int capacity;
+    union {
+        double* numbers;
+        Value* values;
+    } as;
+};
+
+struct ObjMap {
+    Obj obj;
+    bool printing;      // as for ObjList
+    ValueTable table;
+};
+
+// Part of a string, made by slicing or split() without copying the chars.
+// The parent is always a whole string, never another view, and outlives the
+// view: objects are only freed all together. A view isn't interned, so it is
+// turned into a string where identity matters, as for a map key; everything
+// else reads the chars in place.
+struct ObjView {
+    Obj obj;
+    ObjString* parent;
+    int start;
+    int length;
+};
+
 ObjString* copy_string(const char* chars, int length);
+// copy_string() for chars whose hash is already known, such as a snapshot's.
+ObjString* copy_hashed_string(const char* chars, int length, uint32_t hash);
 ObjString* take_string(char* chars, int length);
+// An empty, packed list with room for `capacity` elements.
+ObjList* new_list(int capacity);
+// An empty map sized to take `count` entries before it has to grow.
+ObjMap* new_map(int count);
+// A view of `length` chars of `text` from `start`, which the caller has
+// checked are in range.
+ObjView* new_view(Value text, int start, int length);
+// The interned string with the same chars as `text`.
+ObjString* text_to_string(Value text);
+// Whether two values are a string and a view, or two views, with the same
+// chars. values_equal() asks when two objects aren't the same one.
+bool texts_equal(Value a, Value b);
 
 void print_object(Value value);
+void write_object(OutputBuffer* output, Value value);
 
 static inline bool is_obj_type(Value value, ObjType type) {
     return IS_OBJ(value) && AS_OBJ(value)->type == type;
 }
 
+static inline const char* text_chars(Value text) {
+    if (IS_STRING(text)) return AS_STRING(text)->chars;
+    return AS_VIEW(text)->parent->chars + AS_VIEW(text)->start;
+}
+
+static inline int text_length(Value text) {
+    return IS_STRING(text) ? AS_STRING(text)->length : AS_VIEW(text)->length;
+}
+
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include "output.h"
+
+#include <string.h>
+
+#include "memory.h"
+
+void init_output(OutputBuffer* output, FILE* file, int capacity, FlushPolicy policy) {
+    output->file = file;
+    output->count = 0;
+    output->runStart = 0;
+    output->policy = policy;
+    // Empty until allocated, so free_output() copes with a failed init.
+    output->buffer = NULL;
+    output->capacity = 0;
+    output->buffer = ALLOCATE(char, capacity);
+    output->capacity = capacity;
+}
+
+void free_output(OutputBuffer* output) {
+    flush_output(output);
+    FREE_ARRAY(char, output->buffer, output->capacity);
+    output->buffer = NULL;
+    output->capacity = 0;
+}
+
+void write_output(OutputBuffer* output, const char* chars, int length) {
+    if (output->count + length > output->capacity) {
+        flush_output(output);
+
+        if (length > output->capacity) {
+            fwrite(chars, sizeof(char), length, output->file);
+            return;
+        }
+    }
+
+    memcpy(output->buffer + output->count, chars, length);
+    output->count += length;
+}
+
+void write_output_char(OutputBuffer* output, char c) {
+    if (output->count == output->capacity) flush_output(output);
+    output->buffer[output->count++] = c;
+
+    if (c == '\n' && output->policy == FLUSH_ON_NEWLINE) flush_output(output);
+}
+
+void flush_output(OutputBuffer* output) {
+    if (output->count > 0) {
+        fwrite(output->buffer, sizeof(char), output->count, output->file);
+        output->count = 0;
+    }
+    output->runStart = 0;
+    fflush(output->file);
+}
+
+void mark_output_run(OutputBuffer* output) {
+    output->runStart = output->count;
+}
+
+void drop_output_run(OutputBuffer* output) {
+    output->count = output->runStart;
+}
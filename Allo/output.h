@@ -0,0 +1,36 @@
+#ifndef allo_output_h
+#define allo_output_h
+
+#include <stdio.h>
+
+#include "common.h"
+
+#define OUTPUT_DEFAULT_CAPACITY 8192
+
+typedef enum {
+    FLUSH_ON_NEWLINE,   // interactive use
+    FLUSH_AFTER_RUN,    // when full and whenever an interpret call returns
+    FLUSH_WHEN_FULL,    // when full, on flush_output() and in free_vm()
+} FlushPolicy;
+
+typedef struct {
+    FILE* file;
+    char* buffer;
+    int capacity;
+    int count;
+    int runStart;       // where the current run's output starts in buffer
+    FlushPolicy policy;
+} OutputBuffer;
+
+void init_output(OutputBuffer* output, FILE* file, int capacity, FlushPolicy policy);
+void free_output(OutputBuffer* output);
+
+void write_output(OutputBuffer* output, const char* chars, int length);
+void write_output_char(OutputBuffer* output, char c);
+void flush_output(OutputBuffer* output);
+// Marks where the output of the run about to start begins, so it can be
+// dropped if the run is cut short. Only what is still buffered can be.
+void mark_output_run(OutputBuffer* output);
+void drop_output_run(OutputBuffer* output);
+
+#endif //allo_output_h
@@ -0,0 +1,256 @@
+// clock_gettime() is POSIX, not C11.
+#define _POSIX_C_SOURCE 199309L
+
+#include "profile.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+static uint64_t timestamp() {
+    return __rdtsc();
+}
+#else
+#include <time.h>
+
+static uint64_t timestamp() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+#endif
+
+#define REPORT_ROWS 20
+
+void init_profile(Profile* profile, bool sampling) {
+    profile->chunk = NULL;
+    profile->stops = NULL;
+    profile->ticks = NULL;
+    profile->capacity = 0;
+    profile->lineCounts = NULL;
+    profile->lineTicks = NULL;
+    profile->lineCapacity = 0;
+    memset(profile->pairs, 0, sizeof(profile->pairs));
+    profile->sampling = sampling;
+    profile->untilSample = PROFILE_SAMPLE_INTERVAL;
+    profile->random = 2463534242u;
+    profile->sampledOffset = -1;
+    profile->sampleStart = 0;
+}
+
+void free_profile(Profile* profile) {
+    FREE_ARRAY(uint64_t, profile->stops, profile->capacity);
+    FREE_ARRAY(uint64_t, profile->ticks, profile->capacity);
+    FREE_ARRAY(uint64_t, profile->lineCounts, profile->lineCapacity * OPCODE_COUNT);
+    FREE_ARRAY(uint64_t, profile->lineTicks, profile->lineCapacity * OPCODE_COUNT);
+    init_profile(profile, false);
+}
+
+static void ensure_lines(Profile* profile, int line) {
+    if (line < profile->lineCapacity) return;
+
+    int oldCapacity = profile->lineCapacity;
+    int capacity = oldCapacity;
+    while (capacity <= line) capacity = GROW_CAPACITY(capacity);
+
+    profile->lineCounts = GROW_ARRAY(uint64_t, profile->lineCounts,
+                                     oldCapacity * OPCODE_COUNT, capacity * OPCODE_COUNT);
+    profile->lineTicks = GROW_ARRAY(uint64_t, profile->lineTicks,
+                                    oldCapacity * OPCODE_COUNT, capacity * OPCODE_COUNT);
+    for (int i = oldCapacity * OPCODE_COUNT; i < capacity * OPCODE_COUNT; i++) {
+        profile->lineCounts[i] = 0;
+        profile->lineTicks[i] = 0;
+    }
+    profile->lineCapacity = capacity;
+}
+
+void fold_profile(Profile* profile) {
+    Chunk* chunk = profile->chunk;
+    if (chunk == NULL) return;
+
+    // Every run that stopped past an instruction executed it once.
+    uint64_t* counts = ALLOCATE(uint64_t, chunk->count + 1);
+    counts[chunk->count] = profile->stops[chunk->count];
+    for (int offset = chunk->count - 1; offset >= 0; offset--) {
+        counts[offset] = counts[offset + 1] + profile->stops[offset];
+    }
+
+    int previous = -1;
+    for (int offset = 0; offset < chunk->count; offset += 1 + operandBytes[chunk->code[offset]]) {
+        uint8_t op = chunk->code[offset];
+        // Runs that got past this instruction stopped after its first byte.
+        uint64_t count = counts[offset + 1];
+        if (count > 0) {
+            int line = chunk->lines[offset];
+            ensure_lines(profile, line);
+            profile->lineCounts[line * OPCODE_COUNT + op] += count;
+            profile->lineTicks[line * OPCODE_COUNT + op] += profile->ticks[offset];
+            if (previous != -1) profile->pairs[chunk->code[previous]][op] += count;
+        }
+        previous = offset;
+    }
+
+    FREE_ARRAY(uint64_t, counts, chunk->count + 1);
+    profile->chunk = NULL;
+}
+
+uint32_t profile_chunk(Profile* profile, Chunk* chunk) {
+    profile->sampledOffset = -1;
+    if (profile->chunk != chunk) {
+        fold_profile(profile);
+        if (profile->capacity < chunk->count + 1) {
+            int oldCapacity = profile->capacity;
+            profile->capacity = chunk->count + 1;
+            profile->stops = GROW_ARRAY(uint64_t, profile->stops, oldCapacity, profile->capacity);
+            profile->ticks = GROW_ARRAY(uint64_t, profile->ticks, oldCapacity, profile->capacity);
+        }
+        memset(profile->stops, 0, sizeof(uint64_t) * (chunk->count + 1));
+        memset(profile->ticks, 0, sizeof(uint64_t) * (chunk->count + 1));
+        profile->chunk = chunk;
+    }
+    return profile->sampling ? profile->untilSample : 0;
+}
+
+// Somewhere between half and one and a half intervals (xorshift32).
+static uint32_t next_interval(Profile* profile) {
+    uint32_t x = profile->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    profile->random = x;
+    return PROFILE_SAMPLE_INTERVAL / 2 + x % PROFILE_SAMPLE_INTERVAL;
+}
+
+uint32_t profile_sample(Profile* profile, int offset) {
+    if (profile->sampledOffset != -1) {
+        profile->ticks[profile->sampledOffset] += timestamp() - profile->sampleStart;
+        profile->sampledOffset = -1;
+        return next_interval(profile);
+    }
+
+    // Time this instruction up to the next dispatch.
+    profile->sampledOffset = offset;
+    profile->sampleStart = timestamp();
+    return 1;
+}
+
+void profile_exit(Profile* profile, int offset, uint32_t untilSample) {
+    profile->stops[offset]++;
+    // A sample still open timed the exit itself, which isn't an instruction.
+    if (profile->sampledOffset != -1) {
+        profile->sampledOffset = -1;
+        untilSample = next_interval(profile);
+    }
+    if (profile->sampling) profile->untilSample = untilSample;
+}
+
+typedef struct {
+    uint64_t count;
+    uint64_t ticks;
+    int key;
+} Row;
+
+static int compare_rows(const void* a, const void* b) {
+    const Row* left = a;
+    const Row* right = b;
+    if (left->count != right->count) return left->count < right->count ? 1 : -1;
+    return left->key - right->key;
+}
+
+static double share(uint64_t part, uint64_t total) {
+    return total == 0 ? 0.0 : 100.0 * (double)part / (double)total;
+}
+
+static void print_rows(FILE* out, Row* rows, int count, uint64_t total, uint64_t totalTicks,
+                       bool sampling, const char* (*label)(int key, char* buffer)) {
+    qsort(rows, count, sizeof(Row), compare_rows);
+    char buffer[64];
+    for (int i = 0; i < count && i < REPORT_ROWS && rows[i].count > 0; i++) {
+        fprintf(out, "  %12llu %6.2f%%", (unsigned long long)rows[i].count, share(rows[i].count, total));
+        if (sampling) fprintf(out, " %6.2f%%", share(rows[i].ticks, totalTicks));
+        fprintf(out, "  %s\n", label(rows[i].key, buffer));
+    }
+}
+
+static const char* opcode_label(int key, char* buffer) {
+    (void)buffer;
+    return opcodeNames[key];
+}
+
+static const char* pair_label(int key, char* buffer) {
+    snprintf(buffer, 64, "%s -> %s", opcodeNames[key / OPCODE_COUNT], opcodeNames[key % OPCODE_COUNT]);
+    return buffer;
+}
+
+static const char* line_label(int key, char* buffer) {
+    snprintf(buffer, 64, "line %d", key);
+    return buffer;
+}
+
+void print_profile(Profile* profile, FILE* out) {
+    fold_profile(profile);
+
+    Row opcodes[OPCODE_COUNT];
+    for (int op = 0; op < OPCODE_COUNT; op++) opcodes[op] = (Row){0, 0, op};
+
+    Row* lines = ALLOCATE(Row, profile->lineCapacity);
+    uint64_t total = 0;
+    uint64_t totalTicks = 0;
+    for (int line = 0; line < profile->lineCapacity; line++) {
+        lines[line] = (Row){0, 0, line};
+        for (int op = 0; op < OPCODE_COUNT; op++) {
+            uint64_t count = profile->lineCounts[line * OPCODE_COUNT + op];
+            uint64_t ticks = profile->lineTicks[line * OPCODE_COUNT + op];
+            opcodes[op].count += count;
+            opcodes[op].ticks += ticks;
+            lines[line].count += count;
+            lines[line].ticks += ticks;
+            total += count;
+            totalTicks += ticks;
+        }
+    }
+
+    Row* pairs = ALLOCATE(Row, OPCODE_COUNT * OPCODE_COUNT);
+    uint64_t totalPairs = 0;
+    for (int first = 0; first < OPCODE_COUNT; first++) {
+        for (int second = 0; second < OPCODE_COUNT; second++) {
+            uint64_t count = profile->pairs[first][second];
+            pairs[first * OPCODE_COUNT + second] = (Row){count, 0, first * OPCODE_COUNT + second};
+            totalPairs += count;
+        }
+    }
+
+    const char* ticksHeading = profile->sampling ? "  ticks" : "";
+    fprintf(out, "== Profile: %llu instructions ==\n", (unsigned long long)total);
+    fprintf(out, "\n         count   share%s  opcode\n", ticksHeading);
+    print_rows(out, opcodes, OPCODE_COUNT, total, totalTicks, profile->sampling, opcode_label);
+    fprintf(out, "\n         count   share  opcode pair\n");
+    print_rows(out, pairs, OPCODE_COUNT * OPCODE_COUNT, totalPairs, 0, false, pair_label);
+    fprintf(out, "\n         count   share%s  source\n", ticksHeading);
+    print_rows(out, lines, profile->lineCapacity, total, totalTicks, profile->sampling, line_label);
+
+    FREE_ARRAY(Row, pairs, OPCODE_COUNT * OPCODE_COUNT);
+    FREE_ARRAY(Row, lines, profile->lineCapacity);
+}
+
+bool write_folded_profile(Profile* profile, const char* name, const char* path) {
+    fold_profile(profile);
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL) return false;
+
+    uint64_t* weights = profile->sampling ? profile->lineTicks : profile->lineCounts;
+    for (int line = 0; line < profile->lineCapacity; line++) {
+        for (int op = 0; op < OPCODE_COUNT; op++) {
+            uint64_t weight = weights[line * OPCODE_COUNT + op];
+            if (weight == 0) continue;
+            fprintf(file, "%s;line %d;%s %llu\n", name, line, opcodeNames[op], (unsigned long long)weight);
+        }
+    }
+
+    return fclose(file) == 0;
+}
@@ -0,0 +1,60 @@
+#ifndef allo_profile_h
+#define allo_profile_h
+
+#include <stdio.h>
+
+#include "chunk.h"
+
+// On average every how many instructions one is timed when sampling cycles.
+#define PROFILE_SAMPLE_INTERVAL 64
+
+// Execution counts gathered by run() while profiling. Scripts have no jumps,
+// so a run executes every instruction from the start of its chunk up to where
+// it stopped exactly once, and the instruction before any other is always the
+// one just before it in the chunk. So the VM only records where each run
+// stopped, and per-instruction counts are worked out when the runs of a chunk
+// are folded into the per-line and per-pair totals: once another chunk starts
+// or the chunk is about to be freed.
+typedef struct {
+    // The chunk `stops` and `ticks` are indexed by offset into.
+    Chunk* chunk;
+    uint64_t* stops;        // runs that stopped just before each offset
+    uint64_t* ticks;
+    int capacity;
+
+    // Totals from every chunk folded so far, OPCODE_COUNT entries per line.
+    uint64_t* lineCounts;
+    uint64_t* lineTicks;
+    int lineCapacity;
+    uint64_t pairs[OPCODE_COUNT][OPCODE_COUNT];
+
+    // With sampling on, an instruction picked every PROFILE_SAMPLE_INTERVAL or
+    // so is timed from its dispatch to the next one. The interval varies so
+    // samples don't keep landing on the same instructions.
+    bool sampling;
+    uint32_t untilSample;
+    uint32_t random;
+    int sampledOffset;
+    uint64_t sampleStart;
+} Profile;
+
+void init_profile(Profile* profile, bool sampling);
+void free_profile(Profile* profile);
+
+// Called by run() before running `chunk`. Returns how many instructions to
+// dispatch before calling profile_sample(), or 0 when not sampling.
+uint32_t profile_chunk(Profile* profile, Chunk* chunk);
+// Called with the offset about to run; returns the next countdown.
+uint32_t profile_sample(Profile* profile, int offset);
+// Called by run() when it stops with the next instruction at `offset`.
+void profile_exit(Profile* profile, int offset, uint32_t untilSample);
+// Folds the current chunk's runs into the totals and forgets the chunk.
+void fold_profile(Profile* profile);
+
+// Opcodes, opcode pairs and lines, most executed first.
+void print_profile(Profile* profile, FILE* out);
+// One `name;line N;OPCODE weight` line per line and opcode, for flame graph
+// tools. The weight is sampled ticks when sampling and counts otherwise.
+bool write_folded_profile(Profile* profile, const char* name, const char* path);
+
+#endif //allo_profile_h
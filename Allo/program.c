@@ -0,0 +1,62 @@
+#include "program.h"
+
+#include "compiler.h"
+#include "memory.h"
+#include "virtual_machine.h"
+
+Program* compile_program(const char* source) {
+    size_t memoryUsed = vm.memoryUsed;
+    Program* program = try_reallocate(NULL, 0, sizeof(Program));
+    if (program == NULL) return NULL;
+    atomic_init(&program->refCount, 1);
+    program->allocator = vm.allocator;
+    init_chunk(&program->chunk);
+    init_table(&program->strings);
+    program->objects = NULL;
+
+    // Point the VM's interning at the program's own region while compiling so
+    // every constant string ends up owned by the program, not the VM.
+    Table vmStrings = vm.strings;
+    Obj* vmObjects = vm.objects;
+    Table* vmFrozenStrings = vm.frozenStrings;
+    vm.strings = program->strings;
+    vm.objects = NULL;
+    vm.frozenStrings = NULL;
+
+    bool compiled = compile(source, &program->chunk);
+
+    program->strings = vm.strings;
+    program->objects = vm.objects;
+    vm.strings = vmStrings;
+    vm.objects = vmObjects;
+    vm.frozenStrings = vmFrozenStrings;
+
+    if (!compiled) {
+        release_program(program);
+        program = NULL;
+    }
+
+    vm.memoryUsed = memoryUsed;
+    return program;
+}
+
+Program* retain_program(Program* program) {
+    atomic_fetch_add_explicit(&program->refCount, 1, memory_order_relaxed);
+    return program;
+}
+
+void release_program(Program* program) {
+    if (atomic_fetch_sub_explicit(&program->refCount, 1, memory_order_acq_rel) != 1) return;
+
+    Allocator allocator = vm.allocator;
+    size_t memoryUsed = vm.memoryUsed;
+    vm.allocator = program->allocator;
+
+    free_chunk(&program->chunk);
+    free_table(&program->strings);
+    free_object_list(program->objects);
+    FREE(Program, program);
+
+    vm.allocator = allocator;
+    vm.memoryUsed = memoryUsed;
+}
@@ -0,0 +1,32 @@
+#ifndef allo_program_h
+#define allo_program_h
+
+#include <stdatomic.h>
+
+#include "chunk.h"
+#include "memory.h"
+#include "table.h"
+
+// A compiled script that can be executed many times, by any number of VMs,
+// without recompiling. Once compile_program() returns, a Program is never
+// written to again: its constant strings live in their own frozen intern
+// region instead of the compiling VM's string table, so it can be shared
+// between threads and outlive the VM that compiled it. Its memory comes from
+// the compiling VM's allocator, and goes back there whichever VM releases it
+// last, but only counts against that VM's limit while compiling.
+typedef struct Program {
+    atomic_int refCount;
+    Allocator allocator;
+    Chunk chunk;
+    Table strings;
+    Obj* objects;
+} Program;
+
+// Returns NULL on a compile error, running out of memory included. The caller
+// owns the returned reference.
+Program* compile_program(const char* source);
+
+Program* retain_program(Program* program);
+void release_program(Program* program);
+
+#endif //allo_program_h
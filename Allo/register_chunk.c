@@ -0,0 +1,234 @@
+#include "register_chunk.h"
+
+#include "memory.h"
+
+void init_register_chunk(RegisterChunk* chunk) {
+    chunk->code = NULL;
+    chunk->lines = NULL;
+    chunk->count = 0;
+    chunk->capacity = 0;
+    chunk->constants = NULL;
+    chunk->slotCount = 0;
+    chunk->registerCount = 0;
+}
+
+void free_register_chunk(RegisterChunk* chunk) {
+    FREE_ARRAY(RegisterInstruction, chunk->code, chunk->capacity);
+    FREE_ARRAY(int, chunk->lines, chunk->capacity);
+    init_register_chunk(chunk);
+}
+
+static void write_register_chunk(RegisterChunk* chunk, uint8_t op, uint16_t a,
+                                 uint16_t b, uint16_t c, int line) {
+    if (chunk->capacity < chunk->count + 1) {
+        int oldCapacity = chunk->capacity;
+        int capacity = GROW_CAPACITY(oldCapacity);
+        chunk->code = GROW_ARRAY(RegisterInstruction, chunk->code, oldCapacity, capacity);
+        chunk->lines = GROW_ARRAY(int, chunk->lines, oldCapacity, capacity);
+        chunk->capacity = capacity;
+    }
+
+    chunk->code[chunk->count] = (RegisterInstruction){op, a, b, c};
+    chunk->lines[chunk->count] = line;
+    chunk->count++;
+}
+
+// Follows the stack code with a stack of the registers holding each slot's
+// value. Pushing a constant or a local emits nothing: the slot just refers to
+// that register until something needs the value in the slot itself.
+typedef struct {
+    RegisterChunk* chunk;
+    uint16_t* slots;
+    int depth;
+    int line;
+} Translator;
+
+static void emit(Translator* translator, uint8_t op, uint16_t a, uint16_t b, uint16_t c) {
+    write_register_chunk(translator->chunk, op, a, b, c, translator->line);
+}
+
+static void materialize(Translator* translator, int slot) {
+    if (translator->slots[slot] == slot) return;
+    emit(translator, ROP_MOVE, (uint16_t)slot, translator->slots[slot], 0);
+    translator->slots[slot] = (uint16_t)slot;
+}
+
+// Slots still referring to a register about to be overwritten need their own
+// copy of the old value first.
+static bool prepare_write(Translator* translator, uint16_t reg) {
+    bool copied = false;
+    for (int slot = 0; slot < translator->depth; slot++) {
+        if (slot != reg && translator->slots[slot] == reg) {
+            materialize(translator, slot);
+            copied = true;
+        }
+    }
+    return copied;
+}
+
+static void push(Translator* translator, uint16_t reg) {
+    translator->slots[translator->depth++] = reg;
+}
+
+static uint16_t pop(Translator* translator) {
+    return translator->slots[--translator->depth];
+}
+
+static void emit_unary(Translator* translator, uint8_t op) {
+    uint16_t operand = pop(translator);
+    uint16_t result = (uint16_t)translator->depth;
+    prepare_write(translator, result);
+    emit(translator, op, result, operand, 0);
+    push(translator, result);
+}
+
+static void emit_binary(Translator* translator, uint8_t op) {
+    uint16_t right = pop(translator);
+    uint16_t left = pop(translator);
+    uint16_t result = (uint16_t)translator->depth;
+    prepare_write(translator, result);
+    emit(translator, op, result, left, right);
+    push(translator, result);
+}
+
+static bool writes_a(uint8_t op) {
+    return op != ROP_SET_GLOBAL && op != ROP_DEFINE_GLOBAL &&
+           op != ROP_PRINT && op != ROP_RETURN;
+}
+
+static void set_local(Translator* translator, uint16_t local) {
+    uint16_t value = translator->slots[translator->depth - 1];
+    if (value == local) return;
+
+    RegisterChunk* chunk = translator->chunk;
+    RegisterInstruction* last = chunk->count > 0 ? &chunk->code[chunk->count - 1] : NULL;
+    bool computedHere = value == translator->depth - 1 && last != NULL &&
+                        writes_a(last->op) && last->a == value;
+
+    if (!prepare_write(translator, local) && computedHere) {
+        // `a = b + c` computes straight into the local instead of a
+        // temporary it would then be moved from.
+        last->a = local;
+        translator->slots[translator->depth - 1] = local;
+    } else {
+        emit(translator, ROP_MOVE, local, value, 0);
+    }
+    translator->slots[local] = local;
+}
+
+bool translate_to_registers(Chunk* chunk, RegisterChunk* registers) {
+    init_register_chunk(registers);
+    registers->constants = &chunk->constants;
+    registers->slotCount = chunk->maxStack;
+    registers->registerCount = chunk->maxStack + chunk->constants.count + 3;
+    if (registers->registerCount > UINT16_MAX) return false;
+
+    uint16_t constantBase = (uint16_t)chunk->maxStack;
+    uint16_t nilRegister = (uint16_t)(constantBase + chunk->constants.count);
+
+    Translator translator;
+    translator.chunk = registers;
+    translator.slots = ALLOCATE(uint16_t, chunk->maxStack + 1);
+    translator.depth = 0;
+
+    for (int offset = 0; offset < chunk->count; ) {
+        uint8_t op = chunk->code[offset];
+        uint8_t operand = offset + 1 < chunk->count ? chunk->code[offset + 1] : 0;
+        translator.line = chunk->lines[offset];
+        offset++;
+
+        switch (op) {
+            case OP_CONSTANT: push(&translator, constantBase + operand); offset++; break;
+            case OP_NIL:      push(&translator, nilRegister); break;
+            case OP_TRUE:     push(&translator, nilRegister + 1); break;
+            case OP_FALSE:    push(&translator, nilRegister + 2); break;
+
+            case OP_ADD:
+            case OP_ADD_NUM:
+            case OP_ADD_STRING:
+            case OP_ADD_GENERIC:            emit_binary(&translator, ROP_ADD); break;
+            case OP_SUBTRACT:
+            case OP_SUBTRACT_NUM:           emit_binary(&translator, ROP_SUBTRACT); break;
+            case OP_MULTIPLY:
+            case OP_MULTIPLY_NUM:           emit_binary(&translator, ROP_MULTIPLY); break;
+            case OP_DIVIDE:
+            case OP_DIVIDE_NUM:             emit_binary(&translator, ROP_DIVIDE); break;
+            case OP_GREATER:
+            case OP_GREATER_NUM:            emit_binary(&translator, ROP_GREATER); break;
+            case OP_GREATER_EQUAL:
+            case OP_GREATER_EQUAL_NUM:      emit_binary(&translator, ROP_GREATER_EQUAL); break;
+            case OP_LESS:
+            case OP_LESS_NUM:               emit_binary(&translator, ROP_LESS); break;
+            case OP_LESS_EQUAL:
+            case OP_LESS_EQUAL_NUM:         emit_binary(&translator, ROP_LESS_EQUAL); break;
+            case OP_NEGATE:
+            case OP_NEGATE_NUM:             emit_unary(&translator, ROP_NEGATE); break;
+
+            case OP_ADD_UNCHECKED:          emit_binary(&translator, ROP_ADD_UNCHECKED); break;
+            case OP_SUBTRACT_UNCHECKED:     emit_binary(&translator, ROP_SUBTRACT_UNCHECKED); break;
+            case OP_MULTIPLY_UNCHECKED:     emit_binary(&translator, ROP_MULTIPLY_UNCHECKED); break;
+            case OP_DIVIDE_UNCHECKED:       emit_binary(&translator, ROP_DIVIDE_UNCHECKED); break;
+            case OP_GREATER_UNCHECKED:      emit_binary(&translator, ROP_GREATER_UNCHECKED); break;
+            case OP_GREATER_EQUAL_UNCHECKED:
+                emit_binary(&translator, ROP_GREATER_EQUAL_UNCHECKED);
+                break;
+            case OP_LESS_UNCHECKED:         emit_binary(&translator, ROP_LESS_UNCHECKED); break;
+            case OP_LESS_EQUAL_UNCHECKED:   emit_binary(&translator, ROP_LESS_EQUAL_UNCHECKED); break;
+            case OP_NEGATE_UNCHECKED:       emit_unary(&translator, ROP_NEGATE_UNCHECKED); break;
+
+            case OP_EQUAL:      emit_binary(&translator, ROP_EQUAL); break;
+            case OP_NOT_EQUAL:  emit_binary(&translator, ROP_NOT_EQUAL); break;
+            case OP_NOT:        emit_unary(&translator, ROP_NOT); break;
+
+            case OP_PRINT:
+                emit(&translator, ROP_PRINT, pop(&translator), 0, 0);
+                break;
+            case OP_POP:
+                pop(&translator);
+                break;
+            case OP_DUP:
+                push(&translator, translator.slots[translator.depth - 1]);
+                break;
+
+            case OP_DEFINE_GLOBAL:
+                emit(&translator, ROP_DEFINE_GLOBAL, constantBase + operand, pop(&translator), 0);
+                offset++;
+                break;
+            case OP_GET_GLOBAL: {
+                uint16_t result = (uint16_t)translator.depth;
+                prepare_write(&translator, result);
+                emit(&translator, ROP_GET_GLOBAL, result, constantBase + operand, 0);
+                push(&translator, result);
+                offset++;
+                break;
+            }
+            case OP_SET_GLOBAL:
+                emit(&translator, ROP_SET_GLOBAL, constantBase + operand,
+                     translator.slots[translator.depth - 1], 0);
+                offset++;
+                break;
+            case OP_GET_LOCAL:
+                materialize(&translator, operand);
+                push(&translator, operand);
+                offset++;
+                break;
+            case OP_SET_LOCAL:
+                set_local(&translator, operand);
+                offset++;
+                break;
+
+            case OP_RETURN:
+                emit(&translator, ROP_RETURN, 0, 0, 0);
+                break;
+
+            default:
+                // No register form yet, as for the list instructions: the
+                // chunk runs on the stack interpreter instead.
+                FREE_ARRAY(uint16_t, translator.slots, chunk->maxStack + 1);
+                return false;
+        }
+    }
+
+    FREE_ARRAY(uint16_t, translator.slots, chunk->maxStack + 1);
+    return true;
+}
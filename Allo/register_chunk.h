@@ -0,0 +1,70 @@
+#ifndef allo_register_chunk_h
+#define allo_register_chunk_h
+
+#include "chunk.h"
+
+// Three-address instructions over a register file. Registers 0 to
+// slotCount - 1 are the stack slots of the chunk the code was translated
+// from, so locals keep their slot numbers. The chunk's constants follow,
+// then nil, true and false, so every operand is just a register index.
+typedef enum {
+    ROP_MOVE,                   // A = B
+
+    ROP_ADD,                    // A = B + C, checked
+    ROP_SUBTRACT,
+    ROP_MULTIPLY,
+    ROP_DIVIDE,
+    ROP_GREATER,
+    ROP_GREATER_EQUAL,
+    ROP_LESS,
+    ROP_LESS_EQUAL,
+    ROP_NEGATE,                 // A = -B, checked
+
+    ROP_ADD_UNCHECKED,          // as above with operands proven numbers
+    ROP_SUBTRACT_UNCHECKED,
+    ROP_MULTIPLY_UNCHECKED,
+    ROP_DIVIDE_UNCHECKED,
+    ROP_GREATER_UNCHECKED,
+    ROP_GREATER_EQUAL_UNCHECKED,
+    ROP_LESS_UNCHECKED,
+    ROP_LESS_EQUAL_UNCHECKED,
+    ROP_NEGATE_UNCHECKED,
+
+    ROP_EQUAL,                  // A = B == C
+    ROP_NOT_EQUAL,
+    ROP_NOT,                    // A = !B
+
+    ROP_GET_GLOBAL,             // A = global named by register B
+    ROP_SET_GLOBAL,             // global named by register A = B
+    ROP_DEFINE_GLOBAL,          // define global named by register A as B
+    ROP_PRINT,                  // print A
+    ROP_RETURN,
+} RegisterOpCode;
+
+typedef struct {
+    uint8_t op;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+} RegisterInstruction;
+
+typedef struct {
+    RegisterInstruction* code;
+    int* lines;
+    int count;
+    int capacity;
+    // Borrowed from the translated chunk, which has to outlive this one.
+    ValueArray* constants;
+    int slotCount;
+    int registerCount;
+} RegisterChunk;
+
+void init_register_chunk(RegisterChunk* chunk);
+void free_register_chunk(RegisterChunk* chunk);
+
+// Fills `registers` with code equivalent to the stack code in `chunk`. Fails
+// if the chunk needs more registers than an operand can name, or uses an
+// instruction with no register form.
+bool translate_to_registers(Chunk* chunk, RegisterChunk* registers);
+
+#endif //allo_register_chunk_h
@@ -11,7 +11,7 @@ typedef struct {
     int line;
 } Scanner;
 
-Scanner scanner;
+_Thread_local Scanner scanner;
 
 static bool is_digit(char c) {
     return c >= '0'&& c <= '9';
@@ -95,9 +95,12 @@ Token scan_token() {
         case ')': return make_token(TOKEN_RIGHT_PAREN);
         case '{': return make_token(TOKEN_LEFT_BRACE);
         case '}': return make_token(TOKEN_RIGHT_BRACE);
+        case '[': return make_token(TOKEN_LEFT_BRACKET);
+        case ']': return make_token(TOKEN_RIGHT_BRACKET);
         case ';': return make_token(TOKEN_SEMICOLON);
         case ',': return make_token(TOKEN_COMMA);
         case '.': return make_token(TOKEN_DOT);
+        case ':': return make_token(TOKEN_COLON);
         case '-': return make_token(TOKEN_MINUS);
         case '+': return make_token(TOKEN_PLUS);
         case '/': return make_token(TOKEN_SLASH);
@@ -142,6 +145,7 @@ void skip_white_space() {
                 if (peek_next() == '/') {
                     while (peek() != '\n' && !is_at_end()) advance();
                 } else return;
+                break;
             default:
                 return;
         }
@@ -182,7 +186,7 @@ TokenType identifier_type() {
             return TOKEN_IDENTIFIER;
     }
 
-    // return TOKEN_IDENTIFIER;
+    return TOKEN_IDENTIFIER;
 }
 
 TokenType check_keyword(int start, int length, const char *rest, TokenType type) {
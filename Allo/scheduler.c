@@ -0,0 +1,85 @@
+#include "scheduler.h"
+
+#include <string.h>
+
+#include "memory.h"
+#include "trace.h"
+
+void init_scheduler(Scheduler* scheduler, uint64_t slice, uint64_t sliceNs) {
+    scheduler->tasks = NULL;
+    scheduler->count = 0;
+    scheduler->capacity = 0;
+    scheduler->next = 0;
+    scheduler->unfinished = 0;
+    scheduler->slice = slice;
+    scheduler->sliceNs = sliceNs;
+}
+
+void free_scheduler(Scheduler* scheduler) {
+    for (int i = 0; i < scheduler->count; i++) {
+        swap_vm(&scheduler->tasks[i].vm);
+        free_vm();
+        swap_vm(&scheduler->tasks[i].vm);
+    }
+    FREE_ARRAY(Task, scheduler->tasks, scheduler->capacity);
+    init_scheduler(scheduler, scheduler->slice, scheduler->sliceNs);
+}
+
+int spawn_task(Scheduler* scheduler, Program* program) {
+    if (scheduler->count == scheduler->capacity) {
+        int oldCapacity = scheduler->capacity;
+        scheduler->capacity = GROW_CAPACITY(oldCapacity);
+        scheduler->tasks = GROW_ARRAY(Task, scheduler->tasks, oldCapacity, scheduler->capacity);
+    }
+
+    Task* task = &scheduler->tasks[scheduler->count];
+    memset(&task->vm, 0, sizeof(VM));
+    task->result = INTERPRET_YIELD;
+    task->finished = false;
+
+    // The new VM is set up in the thread's slot, where the caller's waits.
+    swap_vm(&task->vm);
+    init_vm();
+    bool begun = begin_program(program);
+    swap_vm(&task->vm);
+
+    if (begun) {
+        scheduler->unfinished++;
+    } else {
+        task->result = INTERPRET_RUNTIME_ERROR;
+        task->finished = true;
+    }
+    return scheduler->count++;
+}
+
+bool run_next_task(Scheduler* scheduler) {
+    if (scheduler->unfinished == 0) return false;
+
+    while (scheduler->tasks[scheduler->next].finished) {
+        scheduler->next = (scheduler->next + 1) % scheduler->count;
+    }
+    Task* task = &scheduler->tasks[scheduler->next];
+    scheduler->next = (scheduler->next + 1) % scheduler->count;
+
+    uint64_t deadline = scheduler->sliceNs != 0 ? trace_clock() + scheduler->sliceNs : 0;
+    swap_vm(&task->vm);
+    task->result = run_budget(scheduler->slice, deadline);
+    swap_vm(&task->vm);
+
+    if (task->result != INTERPRET_YIELD) {
+        task->finished = true;
+        scheduler->unfinished--;
+    }
+    return true;
+}
+
+void run_scheduler(Scheduler* scheduler) {
+    while (run_next_task(scheduler)) {}
+}
+
+atomic_bool* task_interrupt_flag(Scheduler* scheduler, int task) {
+    swap_vm(&scheduler->tasks[task].vm);
+    atomic_bool* flag = interrupt_flag();
+    swap_vm(&scheduler->tasks[task].vm);
+    return flag;
+}
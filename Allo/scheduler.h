@@ -0,0 +1,45 @@
+#ifndef allo_scheduler_h
+#define allo_scheduler_h
+
+#include "program.h"
+#include "virtual_machine.h"
+
+// A run of a program in a VM of its own, swapped into the thread's slot for
+// each of its slices.
+typedef struct {
+    VM vm;
+    InterpretResult result;
+    bool finished;
+} Task;
+
+// Runs any number of tasks on the calling thread, round robin, giving each a
+// slice of at most `slice` instructions and, unless `sliceNs` is 0, about that
+// many nanoseconds before moving on to the next.
+typedef struct {
+    Task* tasks;
+    int count;
+    int capacity;
+    int next;
+    int unfinished;
+    uint64_t slice;
+    uint64_t sliceNs;
+} Scheduler;
+
+void init_scheduler(Scheduler* scheduler, uint64_t slice, uint64_t sliceNs);
+// Frees every task's VM, finished or not.
+void free_scheduler(Scheduler* scheduler);
+
+// Starts `program` in a fresh VM and returns the task's index. The task holds
+// a reference to the program until the scheduler is freed. A task there was
+// no memory to start is finished from the outset, with a runtime error.
+int spawn_task(Scheduler* scheduler, Program* program);
+// Gives the next unfinished task one slice. Returns false, without running
+// anything, once every task has finished.
+bool run_next_task(Scheduler* scheduler);
+// Runs slices until every task has finished.
+void run_scheduler(Scheduler* scheduler);
+// The interrupt flag of the task's VM; see interrupt_flag(). Setting it stops
+// the task with INTERPRET_TIMEOUT at the end of its current or next slice.
+atomic_bool* task_interrupt_flag(Scheduler* scheduler, int task);
+
+#endif //allo_scheduler_h
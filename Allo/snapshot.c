@@ -0,0 +1,253 @@
+// open(), fstat() and mmap() are POSIX, not C11.
+#define _POSIX_C_SOURCE 200809L
+
+#include "snapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SNAPSHOT_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "memory.h"
+#include "object.h"
+#include "trace.h"
+#include "virtual_machine.h"
+
+#define SNAPSHOT_MAGIC "ALLOSNAP"
+#define SNAPSHOT_VERSION 1
+// Reads back differently on a host of the other byte order.
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+// The file is the header, then the string and global records, then every
+// string's chars, each NUL-terminated. All three parts are 8-byte aligned.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t stringCount;
+    uint32_t globalCount;
+    uint64_t charsSize;
+} SnapshotHeader;
+
+typedef struct {
+    uint64_t offset;        // into the chars
+    uint32_t length;
+    uint32_t hash;
+} SnapshotString;
+
+typedef struct {
+    uint32_t key;           // index of the name among the strings
+    uint32_t type;          // ValueType
+    union {
+        double number;
+        uint64_t boolean;
+        uint64_t string;    // index among the strings
+    } as;
+} SnapshotGlobal;
+
+typedef struct {
+    Table indexes;          // each string numbered so far, by its number
+    ObjString** strings;
+    int count;
+    int capacity;
+} StringList;
+
+static uint32_t number_string(StringList* list, ObjString* string) {
+    Value index;
+    if (table_get(&list->indexes, string, &index)) return (uint32_t)AS_NUMBER(index);
+
+    if (list->count == list->capacity) {
+        int oldCapacity = list->capacity;
+        list->capacity = GROW_CAPACITY(oldCapacity);
+        list->strings = GROW_ARRAY(ObjString*, list->strings, oldCapacity, list->capacity);
+    }
+    table_set(&list->indexes, string, NUMBER_VAL(list->count));
+    list->strings[list->count] = string;
+    return (uint32_t)list->count++;
+}
+
+static SnapshotGlobal snapshot_global(StringList* list, Entry* entry) {
+    SnapshotGlobal global;
+    global.key = number_string(list, entry->key);
+    global.type = (uint32_t)entry->value.type;
+    global.as.string = 0;
+    switch (entry->value.type) {
+        case VAL_BOOL:   global.as.boolean = AS_BOOL(entry->value); break;
+        case VAL_NIL:    break;
+        case VAL_NUMBER: global.as.number = AS_NUMBER(entry->value); break;
+        case VAL_OBJ:    global.as.string = number_string(list, AS_STRING(entry->value)); break;
+    }
+    return global;
+}
+
+static uint64_t padded(uint64_t size) {
+    return (size + 7) & ~(uint64_t)7;
+}
+
+bool write_snapshot(const char* path) {
+    for (int i = 0; i < vm.globals.capacity; i++) {
+        Entry* entry = &vm.globals.entries[i];
+        if (entry->key != NULL && IS_OBJ(entry->value) && !IS_STRING(entry->value)) return false;
+    }
+
+    StringList list;
+    init_table(&list.indexes);
+    list.strings = NULL;
+    list.count = 0;
+    list.capacity = 0;
+
+    for (int i = 0; i < vm.strings.capacity; i++) {
+        if (vm.strings.entries[i].key != NULL) number_string(&list, vm.strings.entries[i].key);
+    }
+
+    SnapshotGlobal* globals = ALLOCATE(SnapshotGlobal, vm.globals.count);
+    int globalCount = 0;
+    for (int i = 0; i < vm.globals.capacity; i++) {
+        Entry* entry = &vm.globals.entries[i];
+        if (entry->key != NULL) globals[globalCount++] = snapshot_global(&list, entry);
+    }
+
+    SnapshotString* strings = ALLOCATE(SnapshotString, list.count);
+    uint64_t charsSize = 0;
+    for (int i = 0; i < list.count; i++) {
+        strings[i] = (SnapshotString){charsSize, (uint32_t)list.strings[i]->length, list.strings[i]->hash};
+        charsSize += (uint64_t)list.strings[i]->length + 1;
+    }
+
+    SnapshotHeader header;
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.stringCount = (uint32_t)list.count;
+    header.globalCount = (uint32_t)globalCount;
+    header.charsSize = padded(charsSize);
+
+    bool written = false;
+    FILE* file = fopen(path, "wb");
+    if (file != NULL) {
+        written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(strings, sizeof(SnapshotString), list.count, file) == (size_t)list.count &&
+                  fwrite(globals, sizeof(SnapshotGlobal), globalCount, file) == (size_t)globalCount;
+        for (int i = 0; i < list.count && written; i++) {
+            written = fwrite(list.strings[i]->chars, 1, list.strings[i]->length + 1, file) ==
+                      (size_t)list.strings[i]->length + 1;
+        }
+        static const char padding[8] = {0};
+        size_t paddingSize = (size_t)(header.charsSize - charsSize);
+        if (written) written = fwrite(padding, 1, paddingSize, file) == paddingSize;
+        if (fclose(file) != 0) written = false;
+    }
+
+    FREE_ARRAY(SnapshotString, strings, list.count);
+    FREE_ARRAY(SnapshotGlobal, globals, vm.globals.count);
+    FREE_ARRAY(ObjString*, list.strings, list.capacity);
+    free_table(&list.indexes);
+    return written;
+}
+
+// Checks every count, offset and index against the file's size before
+// anything is created from it.
+static bool valid_snapshot(const uint8_t* data, uint64_t size) {
+    if (size < sizeof(SnapshotHeader)) return false;
+
+    const SnapshotHeader* header = (const SnapshotHeader*)data;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != SNAPSHOT_VERSION || header->byteOrder != SNAPSHOT_BYTE_ORDER) {
+        return false;
+    }
+
+    uint64_t expected = sizeof(SnapshotHeader) +
+                        (uint64_t)header->stringCount * sizeof(SnapshotString) +
+                        (uint64_t)header->globalCount * sizeof(SnapshotGlobal);
+    if (header->charsSize > size || expected != size - header->charsSize) return false;
+
+    const SnapshotString* strings = (const SnapshotString*)(header + 1);
+    const SnapshotGlobal* globals = (const SnapshotGlobal*)(strings + header->stringCount);
+    const char* chars = (const char*)(globals + header->globalCount);
+
+    for (uint32_t i = 0; i < header->stringCount; i++) {
+        if (strings[i].length > INT32_MAX || strings[i].offset >= header->charsSize ||
+            header->charsSize - strings[i].offset <= strings[i].length ||
+            chars[strings[i].offset + strings[i].length] != '\0') {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->globalCount; i++) {
+        if (globals[i].key >= header->stringCount || globals[i].type > VAL_OBJ) return false;
+        if (globals[i].type == VAL_OBJ && globals[i].as.string >= header->stringCount) return false;
+    }
+    return true;
+}
+
+static void restore(const uint8_t* data) {
+    const SnapshotHeader* header = (const SnapshotHeader*)data;
+    const SnapshotString* strings = (const SnapshotString*)(header + 1);
+    const SnapshotGlobal* globals = (const SnapshotGlobal*)(strings + header->stringCount);
+    const char* chars = (const char*)(globals + header->globalCount);
+
+    // Stored hashes spare rehashing every string.
+    ObjString** restored = ALLOCATE(ObjString*, header->stringCount);
+    for (uint32_t i = 0; i < header->stringCount; i++) {
+        restored[i] = copy_hashed_string(chars + strings[i].offset, (int)strings[i].length, strings[i].hash);
+    }
+
+    for (uint32_t i = 0; i < header->globalCount; i++) {
+        Value value;
+        switch ((ValueType)globals[i].type) {
+            case VAL_BOOL:   value = BOOL_VAL(globals[i].as.boolean != 0); break;
+            case VAL_NUMBER: value = NUMBER_VAL(globals[i].as.number); break;
+            case VAL_OBJ:    value = OBJ_VAL(restored[globals[i].as.string]); break;
+            case VAL_NIL:
+            default:         value = NIL_VAL; break;
+        }
+        table_set(&vm.globals, restored[globals[i].key], value);
+    }
+
+    FREE_ARRAY(ObjString*, restored, header->stringCount);
+}
+
+bool load_snapshot(const char* path) {
+    TRACE_BEGIN(PHASE_RESTORE_SNAPSHOT);
+    bool loaded = false;
+
+#ifdef SNAPSHOT_MMAP
+    int descriptor = open(path, O_RDONLY);
+    if (descriptor != -1) {
+        struct stat status;
+        if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+            void* data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (data != MAP_FAILED) {
+                loaded = valid_snapshot(data, (uint64_t)status.st_size);
+                if (loaded) restore(data);
+                munmap(data, (size_t)status.st_size);
+            }
+        }
+        close(descriptor);
+    }
+#else
+    FILE* file = fopen(path, "rb");
+    if (file != NULL) {
+        fseek(file, 0L, SEEK_END);
+        long size = ftell(file);
+        rewind(file);
+        // malloc()'s alignment covers the records'.
+        uint8_t* data = size > 0 ? malloc((size_t)size) : NULL;
+        if (data != NULL && fread(data, 1, (size_t)size, file) == (size_t)size) {
+            loaded = valid_snapshot(data, (uint64_t)size);
+            if (loaded) restore(data);
+        }
+        free(data);
+        fclose(file);
+    }
+#endif
+
+    TRACE_END(PHASE_RESTORE_SNAPSHOT);
+    return loaded;
+}
@@ -0,0 +1,19 @@
+#ifndef allo_snapshot_h
+#define allo_snapshot_h
+
+#include "common.h"
+
+// A snapshot is the VM's globals and the strings they and vm.strings reach,
+// written after running a prelude so later runs can start from its state
+// instead of running it again. Objects are stored as indexes, which loading
+// rebases onto the objects it creates. The layout is this build's own native
+// one; loading rejects snapshots from another version or byte order. Fails
+// without writing anything when a global holds a list, a map or a view.
+bool write_snapshot(const char* path);
+
+// Interns the snapshot's strings and defines its globals in the calling
+// thread's VM, over any of the same name. Returns false when the file can't be
+// read or isn't a snapshot this build can load.
+bool load_snapshot(const char* path);
+
+#endif //allo_snapshot_h
@@ -4,7 +4,9 @@
 #include "memory.h"
 #include "object.h"
 #include "table.h"
+#include "trace.h"
 #include "value.h"
+#include "virtual_machine.h"
 
 #define TABLE_MAX_LOAD 0.75
 
@@ -31,6 +33,8 @@ static Entry* find_entry(Entry* entries, int capacity, ObjString* key) {
 }
 
 static void adjust_capacity(Table* table, int capacity) {
+    TRACE_BEGIN(PHASE_TABLE_RESIZE);
+    vm.metrics.tableResizes++;
     Entry* entries = ALLOCATE(Entry, capacity);
     for (int i =0; i<capacity; i++) {
         entries[i].key = NULL;
@@ -51,6 +55,7 @@ static void adjust_capacity(Table* table, int capacity) {
     FREE_ARRAY(Entry, table->entries, table->capacity);
     table->entries = entries;
     table->capacity = capacity;
+    TRACE_END(PHASE_TABLE_RESIZE);
 }
 
 void init_table(Table *table) {
@@ -66,6 +71,7 @@ void free_table(Table *table) {
 }
 
 bool table_get(Table *table, ObjString *key, Value *value) {
+    vm.metrics.tableLookups++;
     if (table->count == 0) return false;
 
     Entry* entry = find_entry(table->entries, table->capacity, key);
@@ -77,6 +83,7 @@ bool table_get(Table *table, ObjString *key, Value *value) {
 }
 
 bool table_set(Table* table, ObjString* key, Value value) {
+    vm.metrics.tableLookups++;
     if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
         int capacity = GROW_CAPACITY(table->capacity);
         adjust_capacity(table, capacity);
@@ -95,6 +102,7 @@ bool table_set(Table* table, ObjString* key, Value value) {
 }
 
 bool table_delete(Table *table, ObjString *key) {
+    vm.metrics.tableLookups++;
     if (table->count == 0) return false;
 
     // Find the entry.
@@ -117,6 +125,7 @@ void table_add_all(Table *from, Table *to) {
 }
 
 ObjString * table_find_string(Table *table, const char *chars, int length, uint32_t hash) {
+    vm.metrics.tableLookups++;
     if (table->count == 0) return NULL;
 
     uint32_t index = hash % table->capacity;
@@ -133,3 +142,172 @@ ObjString * table_find_string(Table *table, const char *chars, int length, uint3
         index = (index + 1) % table->capacity;
     }
 }
+
+void table_probe_lengths(Table* table, uint64_t* keys, uint64_t* total, uint64_t* max) {
+    for (int i = 0; i < table->capacity; i++) {
+        ObjString* key = table->entries[i].key;
+        if (key == NULL) continue;
+
+        // find_entry() starts at the key's home slot and walks forward.
+        uint32_t home = key->hash % table->capacity;
+        uint64_t length = ((uint32_t)i + table->capacity - home) % table->capacity + 1;
+        (*keys)++;
+        *total += length;
+        if (length > *max) *max = length;
+    }
+}
+
+// MurmurHash3's finalizer, folded to 32 bits: every input bit reaches the low
+// bits a power-of-two table masks with.
+static uint32_t mix64(uint64_t bits) {
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+    bits *= 0xc4ceb9fe1a85ec53ULL;
+    bits ^= bits >> 33;
+    return (uint32_t)bits;
+}
+
+uint32_t hash_value(Value value) {
+    uint32_t hash;
+    switch (value.type) {
+        case VAL_BOOL: hash = AS_BOOL(value) ? 0x9e3779b9u : 0x7f4a7c15u; break;
+        case VAL_NIL:  hash = 0x85ebca6bu; break;
+        case VAL_NUMBER: {
+            double number = AS_NUMBER(value);
+            if (number == 0) number = 0;
+            uint64_t bits;
+            memcpy(&bits, &number, sizeof(bits));
+            hash = mix64(bits);
+            break;
+        }
+        case VAL_OBJ:
+            hash = IS_STRING(value) ? AS_STRING(value)->hash
+                                    : mix64((uint64_t)(uintptr_t)AS_OBJ(value));
+            break;
+        default: hash = 0; break;
+    }
+    return hash > VALUE_TABLE_TOMBSTONE ? hash : hash + 2;
+}
+
+static size_t value_table_size(int capacity) {
+    return (size_t)capacity * (sizeof(ValueEntry) + sizeof(uint32_t));
+}
+
+// The slot holding `key`, or else the one to put it in: the first tombstone
+// the probe passed, or the empty slot that ended it.
+static uint32_t find_value_slot(ValueTable* table, Value key, uint32_t hash) {
+    uint32_t mask = (uint32_t)table->capacity - 1;
+    uint32_t index = hash & mask;
+    int64_t tombstone = -1;
+
+    for (;;) {
+        uint32_t slotHash = table->hashes[index];
+        if (slotHash == VALUE_TABLE_EMPTY) {
+            return tombstone != -1 ? (uint32_t)tombstone : index;
+        } else if (slotHash == VALUE_TABLE_TOMBSTONE) {
+            if (tombstone == -1) tombstone = index;
+        } else if (slotHash == hash && values_equal(table->entries[index].key, key)) {
+            return index;
+        }
+
+        index = (index + 1) & mask;
+    }
+}
+
+// Rehashes into `capacity` slots, dropping the tombstones.
+static void resize_value_table(ValueTable* table, int capacity) {
+    TRACE_BEGIN(PHASE_TABLE_RESIZE);
+    vm.metrics.tableResizes++;
+    ValueTable resized;
+    resized.count = 0;
+    resized.used = 0;
+    resized.capacity = capacity;
+    resized.entries = reallocate(NULL, 0, value_table_size(capacity));
+    resized.hashes = (uint32_t*)(resized.entries + capacity);
+    memset(resized.hashes, 0, sizeof(uint32_t) * capacity);
+
+    for (int i = 0; i < table->capacity; i++) {
+        if (!value_table_holds(table, i)) continue;
+
+        uint32_t hash = table->hashes[i];
+        uint32_t slot = find_value_slot(&resized, table->entries[i].key, hash);
+        resized.hashes[slot] = hash;
+        resized.entries[slot] = table->entries[i];
+        resized.count++;
+    }
+    resized.used = resized.count;
+
+    free_value_table(table);
+    *table = resized;
+    TRACE_END(PHASE_TABLE_RESIZE);
+}
+
+void init_value_table(ValueTable* table) {
+    table->count = 0;
+    table->used = 0;
+    table->capacity = 0;
+    table->entries = NULL;
+    table->hashes = NULL;
+}
+
+void free_value_table(ValueTable* table) {
+    reallocate(table->entries, value_table_size(table->capacity), 0);
+    init_value_table(table);
+}
+
+void value_table_reserve(ValueTable* table, int count) {
+    if (count <= 0) return;
+
+    int capacity = GROW_CAPACITY(0);
+    while (count > capacity * TABLE_MAX_LOAD) capacity *= 2;
+    if (capacity > table->capacity) resize_value_table(table, capacity);
+}
+
+bool value_table_get(ValueTable* table, Value key, Value* value) {
+    vm.metrics.tableLookups++;
+    if (table->count == 0) return false;
+
+    uint32_t slot = find_value_slot(table, key, hash_value(key));
+    if (!value_table_holds(table, (int)slot)) return false;
+
+    *value = table->entries[slot].value;
+    return true;
+}
+
+bool value_table_set(ValueTable* table, Value key, Value value) {
+    vm.metrics.tableLookups++;
+    if (table->used + 1 > table->capacity * TABLE_MAX_LOAD) {
+        // Rebuilding drops the tombstones, so a table that is mostly
+        // tombstones is rebuilt at the size it has.
+        int capacity = table->count + 1 > table->capacity * TABLE_MAX_LOAD / 2
+            ? GROW_CAPACITY(table->capacity)
+            : table->capacity;
+        resize_value_table(table, capacity);
+    }
+
+    uint32_t hash = hash_value(key);
+    uint32_t slot = find_value_slot(table, key, hash);
+    bool isNewKey = !value_table_holds(table, (int)slot);
+    if (isNewKey) {
+        table->count++;
+        if (table->hashes[slot] == VALUE_TABLE_EMPTY) table->used++;
+    }
+
+    table->hashes[slot] = hash;
+    table->entries[slot].key = key;
+    table->entries[slot].value = value;
+    return isNewKey;
+}
+
+bool value_table_delete(ValueTable* table, Value key) {
+    vm.metrics.tableLookups++;
+    if (table->count == 0) return false;
+
+    uint32_t slot = find_value_slot(table, key, hash_value(key));
+    if (!value_table_holds(table, (int)slot)) return false;
+
+    table->hashes[slot] = VALUE_TABLE_TOMBSTONE;
+    table->count--;
+    return true;
+}
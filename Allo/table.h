@@ -21,5 +21,46 @@ bool table_set(Table* table, ObjString* key, Value value);
 bool table_delete(Table* table, ObjString* key);
 void table_add_all(Table* from, Table* to);
 ObjString* table_find_string(Table* table, const char* chars, int length, uint32_t hash);
+// Adds how many entries a lookup of each key in the table looks at.
+void table_probe_lengths(Table* table, uint64_t* keys, uint64_t* total, uint64_t* max);
+
+typedef struct {
+    Value key;
+    Value value;
+} ValueEntry;
+
+// The same open addressing as Table, keyed by any Value, for script maps.
+// Each slot's key hash is kept apart from the entries, sixteen to a cache
+// line, so a probe only reads an entry whose hash matches. Hash 0 marks an
+// empty slot and 1 a tombstone; hash_value() never returns either. Both
+// arrays share one allocation, and the capacity is a power of two.
+typedef struct {
+    int count;          // entries
+    int used;           // entries and tombstones
+    int capacity;
+    ValueEntry* entries;
+    uint32_t* hashes;   // just past the entries
+} ValueTable;
+
+#define VALUE_TABLE_EMPTY 0
+#define VALUE_TABLE_TOMBSTONE 1
+
+// Equal values hash alike: -0 like 0, and strings, being interned, by
+// their cached hash. Other objects hash by identity. Keys must not be NaN,
+// which equals nothing and so could never be found again.
+uint32_t hash_value(Value value);
+
+void init_value_table(ValueTable* table);
+void free_value_table(ValueTable* table);
+// Sizes an empty table to take `count` entries without growing.
+void value_table_reserve(ValueTable* table, int count);
+bool value_table_get(ValueTable* table, Value key, Value* value);
+// Returns true if the key is new.
+bool value_table_set(ValueTable* table, Value key, Value value);
+bool value_table_delete(ValueTable* table, Value key);
+
+static inline bool value_table_holds(ValueTable* table, int slot) {
+    return table->hashes[slot] > VALUE_TABLE_TOMBSTONE;
+}
 
 #endif //allo_table_h
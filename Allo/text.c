@@ -0,0 +1,87 @@
+#include "text.h"
+
+#include <string.h>
+
+#include "list.h"
+#include "virtual_machine.h"
+
+// How many chars search() scans between checks for an interrupt.
+#define SEARCH_WINDOW (64 * 1024)
+
+// Where `bound` puts a slice's end, or -1 when it isn't a whole number from
+// 0 to `length`.
+static int slice_bound(Value bound, int fallback, int length) {
+    if (IS_NIL(bound)) return fallback;
+    if (!IS_NUMBER(bound)) return -1;
+    double number = AS_NUMBER(bound);
+    // Also false for NaN.
+    if (!(number >= 0 && number <= length)) return -1;
+    int index = (int)number;
+    return index == number ? index : -1;
+}
+
+const char* text_slice(Value text, Value start, Value end, Value* result) {
+    poll_interrupt();
+    if (!IS_TEXT(text)) return "Only strings can be sliced.";
+    int length = text_length(text);
+    int from = slice_bound(start, 0, length);
+    int to = slice_bound(end, length, length);
+    if (from == -1 || to == -1 || from > to) return "Slice bounds out of range.";
+
+    if (from == 0 && to == length) {
+        *result = text;
+    } else {
+        *result = OBJ_VAL(new_view(text, from, to - from));
+    }
+    return NULL;
+}
+
+// The first `needle` in `length` chars from `chars`, or NULL.
+static const char* search(const char* chars, int length, const char* needle, int needleLength) {
+    if (needleLength == 0) return chars;
+    const char* last = chars + length - needleLength;
+    for (const char* at = chars; at <= last; at++) {
+        // memchr is vectorized in every libc, so only its hits get compared.
+        // It scans a window at a time so a long miss can be interrupted.
+        const char* window = last - at + 1 > SEARCH_WINDOW ? at + SEARCH_WINDOW - 1 : last;
+        const char* hit = memchr(at, needle[0], window - at + 1);
+        if (hit == NULL) {
+            at = window;
+            poll_interrupt();
+            continue;
+        }
+        at = hit;
+        if (memcmp(at + 1, needle + 1, needleLength - 1) == 0) return at;
+    }
+    return NULL;
+}
+
+const char* builtin_split(Value text, Value separator, Value* result) {
+    if (!IS_TEXT(text) || !IS_TEXT(separator) || text_length(separator) == 0) {
+        return "split() needs a string and a non-empty separator.";
+    }
+    const char* chars = text_chars(text);
+    int length = text_length(text);
+    const char* needle = text_chars(separator);
+    int needleLength = text_length(separator);
+
+    *result = OBJ_VAL(new_list(0));
+    int start = 0;
+    for (;;) {
+        poll_interrupt();
+        const char* at = search(chars + start, length - start, needle, needleLength);
+        int end = at == NULL ? length : (int)(at - chars);
+        list_append(*result, OBJ_VAL(new_view(text, start, end - start)));
+        if (at == NULL) break;
+        start = end + needleLength;
+    }
+    return NULL;
+}
+
+const char* builtin_find(Value text, Value needle, Value* result) {
+    if (!IS_TEXT(text) || !IS_TEXT(needle)) return "find() needs two strings.";
+    const char* chars = text_chars(text);
+    const char* at = search(chars, text_length(text), text_chars(needle), text_length(needle));
+    *result = NUMBER_VAL(at == NULL ? -1 : (double)(at - chars));
+    return NULL;
+}
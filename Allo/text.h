@@ -0,0 +1,18 @@
+#ifndef allo_text_h
+#define allo_text_h
+
+#include "object.h"
+
+// What the string instructions do, shared by every backend like the list
+// helpers: each returns NULL once done, or the message of the runtime error
+// to raise instead. Their strings are views of the one sliced or split, so
+// none of them copies chars.
+
+// s[start:end]. A nil bound stands for the start or the end of the string.
+const char* text_slice(Value text, Value start, Value end, Value* result);
+// split(): a list of the pieces between each `separator`, empty ones included.
+const char* builtin_split(Value text, Value separator, Value* result);
+// find(): the index of the first `needle`, or -1.
+const char* builtin_find(Value text, Value needle, Value* result);
+
+#endif //allo_text_h
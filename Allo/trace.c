@@ -0,0 +1,98 @@
+// clock_gettime() is POSIX, not C11.
+#define _POSIX_C_SOURCE 199309L
+
+#include "trace.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+_Thread_local Trace trace;
+
+static const char* const phaseNames[PHASE_COUNT] = {
+    [PHASE_READ_FILE] = "read file",
+    [PHASE_COMPILE] = "compile",
+    [PHASE_INTERN] = "intern constant",
+    [PHASE_EXECUTE] = "execute",
+    [PHASE_TABLE_RESIZE] = "table resize",
+    [PHASE_FREE_VM] = "free_vm",
+    [PHASE_FREE_OBJECTS] = "free_objects",
+    [PHASE_RESTORE_SNAPSHOT] = "restore snapshot",
+};
+
+uint64_t trace_clock() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+// Not through reallocate(), so tracing doesn't show up in the VM's metrics.
+void start_trace(uint32_t capacity) {
+    stop_trace();
+    trace.events = malloc(sizeof(TraceEvent) * capacity);
+    if (trace.events == NULL) return;
+    trace.capacity = capacity;
+    trace.recorded = 0;
+    trace.start = trace_clock();
+    trace.scanNs = 0;
+    trace.tokens = 0;
+}
+
+void stop_trace() {
+    free(trace.events);
+    trace.events = NULL;
+    trace.capacity = 0;
+}
+
+void trace_event(TracePhase phase, char type) {
+    TraceEvent* event = &trace.events[trace.recorded++ % trace.capacity];
+    event->timestamp = trace_clock() - trace.start;
+    event->phase = (uint8_t)phase;
+    event->type = type;
+    event->scanNs = 0;
+    event->tokens = 0;
+    if (phase == PHASE_COMPILE && type == 'E') {
+        event->scanNs = trace.scanNs;
+        event->tokens = trace.tokens;
+        trace.scanNs = 0;
+        trace.tokens = 0;
+    }
+}
+
+bool write_trace(const char* path) {
+    if (!TRACING()) return false;
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL) return false;
+
+    uint64_t first = trace.recorded > trace.capacity ? trace.recorded - trace.capacity : 0;
+    int open[PHASE_COUNT] = {0};
+    bool comma = false;
+
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"otherData\": {\"overwritten_events\": %llu},\n"
+                  "\"traceEvents\": [\n", (unsigned long long)first);
+    for (uint64_t i = first; i < trace.recorded; i++) {
+        TraceEvent* event = &trace.events[i % trace.capacity];
+        if (event->type == 'B') {
+            open[event->phase]++;
+        } else if (open[event->phase] == 0) {
+            continue;
+        } else {
+            open[event->phase]--;
+        }
+
+        fprintf(file, "%s{\"name\": \"%s\", \"cat\": \"allo\", \"ph\": \"%c\", \"ts\": %llu.%03u, "
+                      "\"pid\": 1, \"tid\": 1",
+                comma ? ",\n" : "", phaseNames[event->phase], event->type,
+                (unsigned long long)(event->timestamp / 1000), (unsigned)(event->timestamp % 1000));
+        if (event->phase == PHASE_COMPILE && event->type == 'E') {
+            fprintf(file, ", \"args\": {\"scan_us\": %llu.%03u, \"tokens\": %u}",
+                    (unsigned long long)(event->scanNs / 1000), (unsigned)(event->scanNs % 1000),
+                    event->tokens);
+        }
+        fprintf(file, "}");
+        comma = true;
+    }
+    fprintf(file, "\n]}\n");
+
+    return fclose(file) == 0;
+}
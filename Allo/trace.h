@@ -0,0 +1,62 @@
+#ifndef allo_trace_h
+#define allo_trace_h
+
+#include <stdio.h>
+
+#include "common.h"
+
+// How many events the ring buffer holds before the oldest are overwritten.
+#define TRACE_DEFAULT_CAPACITY (1 << 16)
+
+typedef enum {
+    PHASE_READ_FILE,
+    PHASE_COMPILE,
+    PHASE_INTERN,
+    PHASE_EXECUTE,
+    PHASE_TABLE_RESIZE,
+    PHASE_FREE_VM,
+    PHASE_FREE_OBJECTS,
+    PHASE_RESTORE_SNAPSHOT,
+    PHASE_COUNT,
+} TracePhase;
+
+typedef struct {
+    uint64_t timestamp;     // nanoseconds since start_trace()
+    uint64_t scanNs;        // only on PHASE_COMPILE end events
+    uint32_t tokens;        // likewise
+    uint8_t phase;
+    char type;              // 'B'egin or 'E'nd
+} TraceEvent;
+
+// Begin and end events for the phases of a run, kept in a buffer allocated
+// once up front so recording is a clock read and a store. Like the VM, each
+// thread records into its own.
+typedef struct {
+    TraceEvent* events;     // NULL while not tracing
+    uint32_t capacity;
+    uint64_t recorded;      // ever, so recorded - capacity were overwritten
+    uint64_t start;
+
+    // Scanning is interleaved with compiling token by token, too finely to
+    // give each token events of its own, so the compiler adds its time up
+    // here and the next PHASE_COMPILE end event carries the totals.
+    uint64_t scanNs;
+    uint32_t tokens;
+} Trace;
+
+extern _Thread_local Trace trace;
+
+#define TRACING() (trace.events != NULL)
+#define TRACE_BEGIN(phase) do { if (TRACING()) trace_event((phase), 'B'); } while (false)
+#define TRACE_END(phase) do { if (TRACING()) trace_event((phase), 'E'); } while (false)
+
+void start_trace(uint32_t capacity);
+void stop_trace();
+uint64_t trace_clock();
+void trace_event(TracePhase phase, char type);
+
+// Chrome trace-event JSON, loadable in chrome://tracing or Perfetto. End
+// events whose begin was overwritten are left out.
+bool write_trace(const char* path);
+
+#endif //allo_trace_h
@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include "memory.h"
+#include "number.h"
 #include "object.h"
 
 bool values_equal(Value a, Value b) {
@@ -13,7 +14,7 @@ bool values_equal(Value a, Value b) {
         case VAL_BOOL:   return AS_BOOL(a) == AS_BOOL(b);
         case VAL_NIL:    return true;
         case VAL_NUMBER: return AS_NUMBER(a) == AS_NUMBER(b);
-        case VAL_OBJ:    return AS_OBJ(a) == AS_OBJ(b);
+        case VAL_OBJ:    return AS_OBJ(a) == AS_OBJ(b) || texts_equal(a, b);
         default:         return false;
     }
 }
@@ -27,8 +28,9 @@ void init_value_array(ValueArray *array) {
 void write_value_array(ValueArray *array, Value value) {
     if (array->capacity < array->count + 1) {
         int oldCapacity = array->capacity;
-        array->capacity = GROW_CAPACITY(oldCapacity);
-        array->values = GROW_ARRAY(Value, array->values, oldCapacity, array->capacity);
+        int capacity = GROW_CAPACITY(oldCapacity);
+        array->values = GROW_ARRAY(Value, array->values, oldCapacity, capacity);
+        array->capacity = capacity;
     }
 
     array->values[array->count] = value;
@@ -46,7 +48,31 @@ void print_value(Value value) {
             printf(AS_BOOL(value) ? "true" : "false");
             break;
         case VAL_NIL: printf("nil"); break;
-        case VAL_NUMBER: printf("%g", AS_NUMBER(value)); break;
+        case VAL_NUMBER: {
+            char buffer[NUMBER_BUFFER_SIZE];
+            int length = format_number(AS_NUMBER(value), buffer);
+            printf("%.*s", length, buffer);
+            break;
+        }
         case VAL_OBJ: print_object(value); break;
     }
 }
+
+void write_value(OutputBuffer* output, Value value) {
+    switch (value.type) {
+        case VAL_BOOL:
+            if (AS_BOOL(value)) {
+                write_output(output, "true", 4);
+            } else {
+                write_output(output, "false", 5);
+            }
+            break;
+        case VAL_NIL: write_output(output, "nil", 3); break;
+        case VAL_NUMBER: {
+            char buffer[NUMBER_BUFFER_SIZE];
+            write_output(output, buffer, format_number(AS_NUMBER(value), buffer));
+            break;
+        }
+        case VAL_OBJ: write_object(output, value); break;
+    }
+}
@@ -2,10 +2,15 @@
 #define allo_value_h
 #include <stdbool.h>
 
+#include "output.h"
+
 
 
 typedef struct Obj Obj;
 typedef struct ObjString ObjString;
+typedef struct ObjList ObjList;
+typedef struct ObjMap ObjMap;
+typedef struct ObjView ObjView;
 
 
 typedef enum {
@@ -59,6 +64,7 @@ void free_value_array(ValueArray* array);
 
 
 void print_value(Value value);
+void write_value(OutputBuffer* output, Value value);
 
 
 #endif
\ No newline at end of file
@@ -7,63 +7,301 @@
 #include "debug.h"
 #include "compiler.h"
 #include "memory.h"
+#include "list.h"
+#include "map.h"
 #include "object.h"
-VM vm;
+#include "text.h"
+#include "trace.h"
+_Thread_local VM vm;
+static void unbind_program();
+static InterpretResult run_stack();
 
 void init_vm() {
-    reset_stack();
+    // First, so the allocations below are counted.
+    vm.metrics = (Metrics){0};
+    vm.memoryUsed = 0;
+
+    vm.stack = NULL;
+    vm.stackCapacity = 0;
     vm.objects = NULL;
+    vm.program = NULL;
+    vm.frozenStrings = NULL;
+    init_chunk(&vm.boundChunk);
+    init_register_chunk(&vm.boundRegisters);
+    init_jit_code(&vm.boundJit);
+    vm.boundStops = NULL;
+    vm.boundStopCount = -1;
+    vm.backend = BACKEND_STACK;
+    vm.quickening = (QuickeningStats){0, 0, 0};
+    vm.profile = NULL;
+    vm.suspended = false;
+    vm.interrupt = NULL;
+    vm.interruptible = false;
+    vm.interrupted = false;
     init_table(&vm.strings);
     init_table(&vm.globals);
+
+    // Allocated last, so free_vm() can clean up after either failing.
+    init_output(&vm.output, stdout, OUTPUT_DEFAULT_CAPACITY, FLUSH_AFTER_RUN);
+    // One extra slot below the bottom of the stack lets run() write its
+    // cached top back even when the stack is empty.
+    vm.stack = ALLOCATE(Value, STACK_INITIAL_CAPACITY + 1) + 1;
+    vm.stack[-1] = NIL_VAL;
+    vm.stackCapacity = STACK_INITIAL_CAPACITY;
+    reset_stack();
+    vm.interrupt = ALLOCATE(atomic_bool, 1);
+    atomic_init(vm.interrupt, false);
 }
 
 void free_vm() {
+    TRACE_BEGIN(PHASE_FREE_VM);
     free_table(&vm.strings);
     free_table(&vm.globals);
+    TRACE_BEGIN(PHASE_FREE_OBJECTS);
     free_objects();
+    TRACE_END(PHASE_FREE_OBJECTS);
+    unbind_program();
+    vm.frozenStrings = NULL;
+    free_output(&vm.output);
+    if (vm.stack != NULL) FREE_ARRAY(Value, vm.stack - 1, vm.stackCapacity + 1);
+    vm.stack = NULL;
+    vm.stackCapacity = 0;
+    if (vm.interrupt != NULL) FREE(atomic_bool, vm.interrupt);
+    vm.interrupt = NULL;
+    TRACE_END(PHASE_FREE_VM);
+}
+
+QuickeningStats get_quickening_stats() {
+    return vm.quickening;
+}
+
+Metrics get_metrics() {
+    uint64_t keys = 0;
+    uint64_t total = 0;
+    uint64_t max = 0;
+    table_probe_lengths(&vm.globals, &keys, &total, &max);
+    table_probe_lengths(&vm.strings, &keys, &total, &max);
+    if (vm.frozenStrings != NULL) table_probe_lengths(vm.frozenStrings, &keys, &total, &max);
+
+    Metrics metrics = vm.metrics;
+    metrics.averageProbeLength = keys == 0 ? 0.0 : (double)total / (double)keys;
+    metrics.maxProbeLength = max;
+    return metrics;
+}
+
+void select_backend(Backend backend) {
+    vm.backend = backend;
+}
+
+void set_profile(Profile* profile) {
+    if (vm.profile != NULL) fold_profile(vm.profile);
+    vm.profile = profile;
 }
 
+void configure_output(int capacity, FlushPolicy policy) {
+    FILE* file = vm.output.file;
+    free_output(&vm.output);
+    init_output(&vm.output, file, capacity, policy);
+}
 
-static Value peek(int distance) {
-    return vm.stackTop[-1 - distance];
+void set_output_file(FILE* file) {
+    flush_output(&vm.output);
+    vm.output.file = file;
 }
 
+
 static bool is_falsey(Value value) {
     return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
 }
 
-static void concatenate() {
-    ObjString* b = AS_STRING(pop_stack());
-    ObjString* a = AS_STRING(pop_stack());
-
-    int length = a->length + b->length;
+Value concatenate(Value a, Value b) {
+    poll_interrupt();
+    int length = text_length(a) + text_length(b);
     char* chars = ALLOCATE(char, length + 1);
-    memcpy(chars, a->chars, a->length);
-    memcpy(chars + a->length, b->chars, b->length);
+    memcpy(chars, text_chars(a), text_length(a));
+    memcpy(chars + text_length(a), text_chars(b), text_length(b));
     chars[length] = '\0';
 
     ObjString* result = take_string(chars, length);
-    push_to_stack(OBJ_VAL(result));
+    return OBJ_VAL(result);
+}
+
+// Makes room for everything the chunk about to run can push on top of what
+// is already on the stack, so pushes themselves never need to check.
+static void ensure_stack_capacity(int needed) {
+    if (needed <= vm.stackCapacity) return;
+
+    int capacity = vm.stackCapacity;
+    int depth = (int)(vm.stackTop - vm.stack);
+    while (capacity < needed) capacity = GROW_CAPACITY(capacity);
+
+    vm.stack = GROW_ARRAY(Value, vm.stack - 1, vm.stackCapacity + 1, capacity + 1) + 1;
+    vm.stackCapacity = capacity;
+    vm.stackTop = vm.stack + depth;
+}
+
+static void ensure_stack(Chunk* chunk) {
+    ensure_stack_capacity((int)(vm.stackTop - vm.stack) + chunk->maxStack);
+}
+
+// Native code keeps the stack top in a register; statements leave the stack
+// as they found it, so vm.stackTop is already right once it returns.
+static InterpretResult run_native(Chunk* chunk, JitCode* jit) {
+    ensure_stack(chunk);
+    vm.chunk = chunk;
+    return (InterpretResult)jit->function(vm.stackTop, vm.stack, chunk->constants.values);
+}
+
+// Runs `chunk` on whichever backend is selected. Falls back to the stack VM
+// for a chunk too big to translate or a platform the JIT doesn't target.
+static InterpretResult run_chunk(Chunk* chunk) {
+    if (vm.backend == BACKEND_JIT) {
+        JitCode jit;
+        if (jit_compile(chunk, "script", &jit)) {
+            InterpretResult result = run_native(chunk, &jit);
+            free_jit_code(&jit);
+            return result;
+        }
+    }
+
+    if (vm.backend == BACKEND_REGISTER) {
+        RegisterChunk registers;
+        if (translate_to_registers(chunk, &registers)) {
+            InterpretResult result = run_registers(&registers);
+            free_register_chunk(&registers);
+            return result;
+        }
+        free_register_chunk(&registers);
+    }
+
+    ensure_stack(chunk);
+    vm.chunk = chunk;
+    vm.ip = vm.chunk->code;
+    return run_stack();
+}
+
+atomic_bool* interrupt_flag() {
+    vm.interruptible = true;
+    return vm.interrupt;
+}
+
+// One relaxed load.
+static bool interrupt_pending() {
+    return vm.interrupt != NULL && atomic_load_explicit(vm.interrupt, memory_order_relaxed);
+}
+
+void poll_interrupt() {
+    // Nothing to unwind to outside a run, as in code from --emit-c.
+    if (vm.recover == NULL || !interrupt_pending()) return;
+    vm.interrupted = true;
+    longjmp(*vm.recover, 1);
+}
+
+// Every run starts here, opening the PHASE_EXECUTE finish_run() closes.
+static void start_run() {
+    TRACE_BEGIN(PHASE_EXECUTE);
+    mark_output_run(&vm.output);
+}
+
+// Every run ends here. A run that got to its end while interrupted counts as
+// timed out too, and a timed out run's output that is still buffered is
+// dropped before anything is flushed. The interrupt was aimed at this run, so
+// it is cleared whatever the run's result.
+static InterpretResult finish_run(InterpretResult result) {
+    TRACE_END(PHASE_EXECUTE);
+    if (result == INTERPRET_OK && interrupt_pending()) {
+        reset_stack();
+        result = INTERPRET_TIMEOUT;
+    }
+    if (vm.interrupt != NULL) atomic_store_explicit(vm.interrupt, false, memory_order_relaxed);
+    if (result == INTERPRET_TIMEOUT) drop_output_run(&vm.output);
+    if (vm.output.policy != FLUSH_WHEN_FULL) flush_output(&vm.output);
+    if (metrics_dump_requested()) {
+        Metrics metrics = get_metrics();
+        write_metrics_json(&metrics, stderr);
+    }
+    return result;
+}
+
+static void report_runtime_error(int line, const char* format, va_list args) {
+    // Keep stdout ahead of the error message unless the host opted out.
+    if (vm.output.policy != FLUSH_WHEN_FULL) flush_output(&vm.output);
+
+    vfprintf(stderr, format, args);
+    fputs("\n", stderr);
+
+    fprintf(stderr, "[line %d] in script\n", line);
+    reset_stack();
 }
 
 static void runtime_error(const char* format, ...) {
+    size_t instruction = vm.ip - vm.chunk->code - 1;
+
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+    report_runtime_error(vm.chunk->lines[instruction], format, args);
     va_end(args);
-    fputs("\n", stderr);
+}
+
+void runtime_error_at(int line, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    report_runtime_error(line, format, args);
+    va_end(args);
+}
 
+bool run_protected(void (*body)(void* context), void* context) {
+    jmp_buf recover;
+    jmp_buf* enclosing = vm.recover;
+    vm.recover = &recover;
 
-    size_t instruction = vm.ip - vm.chunk->code - 1;
-    int line = vm.chunk->lines[instruction];
-    fprintf(stderr, "[line %d] in script\n", line);
+    if (setjmp(recover) != 0) {
+        vm.recover = enclosing;
+        return false;
+    }
+
+    body(context);
+    vm.recover = enclosing;
+    return true;
+}
+
+// run() keeps ip to itself, so unlike other runtime errors this one has no
+// line to report.
+static InterpretResult report_out_of_memory() {
+    if (vm.output.policy != FLUSH_WHEN_FULL) flush_output(&vm.output);
+    fputs("Out of memory.\n", stderr);
+    reset_stack();
+    return INTERPRET_RUNTIME_ERROR;
+}
+
+// What a protected run is asked to execute, and how it ended.
+typedef struct {
+    Chunk* chunk;
+    Program* program;
+    InterpretResult result;
+} RunRequest;
+
+static InterpretResult run_request(void (*body)(void* context), RunRequest* request) {
+    if (run_protected(body, request)) return request->result;
+    if (!vm.interrupted) return report_out_of_memory();
+    vm.interrupted = false;
     reset_stack();
+    return INTERPRET_TIMEOUT;
+}
+
+static void run_chunk_body(void* context) {
+    RunRequest* request = context;
+    request->result = run_chunk(request->chunk);
+}
+
+static void run_stack_body(void* context) {
+    RunRequest* request = context;
+    request->result = run();
 }
 
 InterpretResult interpret_chunk(Chunk* chunk) {
-    vm.chunk = chunk;
-    vm.ip = vm.chunk->code;
-    return run();
+    start_run();
+    return finish_run(run_request(run_chunk_body, &(RunRequest){.chunk = chunk}));
 }
 
 InterpretResult interpret_code(const char *source) {
@@ -75,37 +313,306 @@ InterpretResult interpret_code(const char *source) {
         return INTERPRET_COMPILE_ERROR;
     }
 
-    vm.chunk = &chunk;
+    start_run();
+    InterpretResult result = finish_run(run_request(run_chunk_body, &(RunRequest){.chunk = &chunk}));
+
+    if (vm.profile != NULL && vm.profile->chunk == &chunk) fold_profile(vm.profile);
+    free_chunk(&chunk);
+
+    return result;
+}
+
+static void unbind_program() {
+    if (vm.program == NULL) return;
+
+    if (vm.profile != NULL && vm.profile->chunk == &vm.boundChunk) fold_profile(vm.profile);
+    if (vm.boundStops != NULL) FREE_ARRAY(int, vm.boundStops, vm.boundChunk.count / DEADLINE_CHECK_INTERVAL);
+    FREE_ARRAY(uint8_t, vm.boundChunk.code, vm.boundChunk.count);
+    init_chunk(&vm.boundChunk);
+    free_register_chunk(&vm.boundRegisters);
+    free_jit_code(&vm.boundJit);
+    vm.boundStops = NULL;
+    vm.boundStopCount = -1;
+    release_program(vm.program);
+    vm.program = NULL;
+    vm.frozenStrings = NULL;
+}
+
+void bind_program(Program* program) {
+    // Globals defined under another program are keyed by that program's
+    // strings, which are not the ones this program will look up.
+    free_table(&vm.globals);
+    unbind_program();
+
+    // Everything is allocated before the VM takes any of it, so running out
+    // of memory part way leaves the VM unbound rather than half bound.
+    uint8_t* code = ALLOCATE(uint8_t, program->chunk.count);
+    memcpy(code, program->chunk.code, program->chunk.count);
+
+    RegisterChunk registers;
+    init_register_chunk(&registers);
+    if (vm.backend == BACKEND_REGISTER && !translate_to_registers(&program->chunk, &registers)) {
+        free_register_chunk(&registers);
+    }
+    // Compiled from the program's own bytecode, which quickening never touches.
+    JitCode jit;
+    init_jit_code(&jit);
+    if (vm.backend == BACKEND_JIT) jit_compile(&program->chunk, "program", &jit);
+
+    vm.program = retain_program(program);
+    vm.frozenStrings = &program->strings;
+
+    vm.boundChunk = program->chunk;
+    vm.boundChunk.code = code;
+    vm.boundChunk.capacity = program->chunk.count;
+    vm.boundRegisters = registers;
+    vm.boundJit = jit;
+}
+
+static void run_program_body(void* context) {
+    RunRequest* request = context;
+    Program* program = request->program;
+    if (vm.program != program) bind_program(program);
+
+    reset_stack();
+    if (vm.boundRegisters.code != NULL) {
+        request->result = run_registers(&vm.boundRegisters);
+        return;
+    }
+    if (vm.boundJit.function != NULL) {
+        request->result = run_native(&program->chunk, &vm.boundJit);
+        return;
+    }
+
+    ensure_stack(&vm.boundChunk);
+    vm.chunk = &vm.boundChunk;
     vm.ip = vm.chunk->code;
+    request->result = run_stack();
+}
 
-    InterpretResult result = run();
+InterpretResult interpret_program(Program* program) {
+    start_run();
+    return finish_run(run_request(run_program_body, &(RunRequest){.program = program}));
+}
 
-    free_chunk(&chunk);
+static void begin_program_body(void* context) {
+    Program* program = context;
+    if (vm.program != program) bind_program(program);
+
+    reset_stack();
+    ensure_stack(&vm.boundChunk);
+    vm.chunk = &vm.boundChunk;
+    vm.ip = vm.chunk->code;
+    vm.suspended = true;
+    mark_output_run(&vm.output);
+}
 
+bool begin_program(Program* program) {
+    if (run_protected(begin_program_body, program)) return true;
+    report_out_of_memory();
+    return false;
+}
+
+// Runs from vm.ip up to the instruction at `stop`, or to the end when NULL.
+// Each call is a run of its own, so the instruction the OP_YIELD replaced is
+// put back however the run ends.
+static InterpretResult run_to(uint8_t* stop) {
+    if (stop == NULL) return run_request(run_stack_body, &(RunRequest){0});
+
+    uint8_t replaced = *stop;
+    *stop = OP_YIELD;
+    InterpretResult result = run_request(run_stack_body, &(RunRequest){0});
+    *stop = replaced;
     return result;
 }
 
+// Runs at most `instructions` instructions. Scripts have no jumps, so the run
+// reaches the instruction that many on from vm.ip and no other first; an
+// OP_YIELD written over it stops the run there, and run() itself needs no
+// check per instruction.
+static InterpretResult run_slice(uint64_t instructions) {
+    uint8_t* stop = vm.ip;
+    uint8_t* end = vm.chunk->code + vm.chunk->count;
+    for (uint64_t i = 0; i < instructions && stop < end; i++) {
+        stop += 1 + operandBytes[*stop];
+    }
+    return run_to(stop < end ? stop : NULL);
+}
+
+// Finding where a slice stops costs about as much as running it, so a bound
+// program, which runs from its start every time, has its stops found once.
+static void find_bound_stops() {
+    Chunk* chunk = &vm.boundChunk;
+    // Every instruction takes at least a byte.
+    int* stops = ALLOCATE(int, chunk->count / DEADLINE_CHECK_INTERVAL);
+    int count = 0;
+    int instruction = 0;
+    for (int offset = 0; offset < chunk->count; offset += 1 + operandBytes[chunk->code[offset]]) {
+        if (instruction != 0 && instruction % DEADLINE_CHECK_INTERVAL == 0) stops[count++] = offset;
+        instruction++;
+    }
+    vm.boundStops = stops;
+    vm.boundStopCount = count;
+}
+
+// Runs the stack interpreter from vm.ip to the end of vm.chunk, a slice at a
+// time once the VM's interrupt flag has been handed out, checking the flag
+// between slices.
+static InterpretResult run_stack() {
+    // A chunk too short for a check needs no slicing either.
+    if (!vm.interruptible || vm.chunk->count <= DEADLINE_CHECK_INTERVAL) return run();
+
+    bool bound = vm.chunk == &vm.boundChunk && vm.ip == vm.chunk->code;
+    if (bound && vm.boundStopCount == -1) find_bound_stops();
+    for (int next = 0;; next++) {
+        InterpretResult result;
+        if (!bound) {
+            result = run_slice(DEADLINE_CHECK_INTERVAL);
+        } else {
+            result = run_to(next < vm.boundStopCount ? vm.chunk->code + vm.boundStops[next] : NULL);
+        }
+        if (result != INTERPRET_YIELD) return result;
+        if (interrupt_pending()) {
+            reset_stack();
+            return INTERPRET_TIMEOUT;
+        }
+    }
+}
+
+InterpretResult run_budget(uint64_t instructions, uint64_t deadline) {
+    if (!vm.suspended) return INTERPRET_OK;
+
+    TRACE_BEGIN(PHASE_EXECUTE);
+    InterpretResult result = INTERPRET_YIELD;
+    while (instructions > 0) {
+        uint64_t slice = instructions;
+        if (deadline != 0 && slice > DEADLINE_CHECK_INTERVAL) slice = DEADLINE_CHECK_INTERVAL;
+        instructions -= slice;
+
+        result = run_slice(slice);
+        if (result != INTERPRET_YIELD) break;
+        if (interrupt_pending()) {
+            reset_stack();
+            result = INTERPRET_TIMEOUT;
+            break;
+        }
+        if (deadline != 0 && trace_clock() >= deadline) break;
+    }
+
+    if (result == INTERPRET_YIELD) {
+        TRACE_END(PHASE_EXECUTE);
+        return result;
+    }
+    vm.suspended = false;
+    return finish_run(result);
+}
+
+void swap_vm(VM* other) {
+    VM current = vm;
+    vm = *other;
+    *other = current;
+}
+
 InterpretResult run() {
-#define READ_BYTE() (*vm.ip++)
+    // The instruction pointer, the stack pointer and the value on top of the
+    // stack are kept in locals so they can live in registers. `top` points at
+    // the slot the top value belongs in, but that slot is only written when
+    // something below is pushed or when STORE_FRAME() hands the state back to
+    // the VM before calling out, reporting an error or tracing.
+    uint8_t* ip;
+    Value* top;
+    Value tos;
+    Value* slots = vm.stack;
+    // Counted locally: bumping vm.quickening.hits or vm.metrics.instructions
+    // on every instruction would chain each one to the previous through a
+    // store.
+    uint64_t quickenedHits = 0;
+    uint64_t executed = 0;
+    // Counts down to the next cycle sample; 0 unless sampling. Execution
+    // counts cost nothing per instruction (see profile.h), but checking the
+    // countdown does, so sampling is only compiled in with ALLO_PROFILE_CYCLES.
+    uint32_t untilSample = vm.profile != NULL ? profile_chunk(vm.profile, vm.chunk) : 0;
+
+#define LOAD_FRAME() (ip = vm.ip, top = vm.stackTop - 1, tos = *top)
+#define STORE_FRAME()                                                   \
+    (*top = tos, vm.stackTop = top + 1, vm.ip = ip,                     \
+     vm.quickening.hits += quickenedHits, quickenedHits = 0,            \
+     vm.metrics.instructions += executed, executed = 0)
+// Returns once the frame is stored, telling the profiler where the run stopped.
+#define FINISH(result)                                                  \
+    do {                                                                \
+        if (vm.profile != NULL) {                                       \
+            profile_exit(vm.profile, (int)(ip - vm.chunk->code), untilSample); \
+        }                                                               \
+        return result;                                                  \
+    } while (false)
+#define PUSH(value) (*top++ = tos, tos = (value))
+#define DROP() (tos = *--top)
+#define READ_BYTE() (*ip++)
 #define READ_CONSTANT() (vm.chunk->constants.values[READ_BYTE()])
 #define READ_STRING() AS_STRING(READ_CONSTANT())
-#define NEGATE(ptr) (*(ptr-1) = NUMBER_VAL(-AS_NUMBER(*(ptr-1))))
-#define BINARY_OP(valueType, op)                            \
+#define RAISE_ERROR(...)                                    \
+    do {                                                    \
+        STORE_FRAME();                                      \
+        runtime_error(__VA_ARGS__);                         \
+        FINISH(INTERPRET_RUNTIME_ERROR);                    \
+    } while (false)
+// Rewrites the instruction just read. A deoptimized instruction is
+// re-executed in its generic form, counted as one instruction.
+#define QUICKEN(specialized) (ip[-1] = (specialized), vm.quickening.quickened++)
+#define DEOPTIMIZE(generic)                                 \
+    {                                                       \
+        ip[-1] = (generic);                                 \
+        vm.quickening.misses++;                             \
+        executed--;                                         \
+        ip--;                                               \
+        break;                                              \
+    }
+// A miss where the generic form could only raise the same error.
+#define GUARD_FAILED(message)                               \
+    do {                                                    \
+        vm.quickening.misses++;                             \
+        RAISE_ERROR(message);                               \
+    } while (false)
+#define BINARY_OP(valueType, op, specialized)               \
     do {                                                    \
-      if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) {     \
-        runtime_error("Operands must be numbers.");          \
-        return INTERPRET_RUNTIME_ERROR;                     \
+      if (!IS_NUMBER(tos) || !IS_NUMBER(top[-1])) {         \
+        RAISE_ERROR("Operands must be numbers.");           \
       }                                                     \
-      double b = AS_NUMBER(pop_stack());                          \
-      double a = AS_NUMBER(pop_stack());                          \
-      push_to_stack(valueType(a op b));                              \
+      QUICKEN(specialized);                                 \
+      double b = AS_NUMBER(tos);                            \
+      top--;                                                \
+      tos = valueType(AS_NUMBER(*top) op b);                \
+    } while (false)
+#define NUMBER_OP(valueType, op)                            \
+    do {                                                    \
+      if (!IS_NUMBER(tos) || !IS_NUMBER(top[-1])) {         \
+        GUARD_FAILED("Operands must be numbers.");          \
+      }                                                     \
+      quickenedHits++;                                      \
+      double b = AS_NUMBER(tos);                            \
+      top--;                                                \
+      tos = valueType(AS_NUMBER(*top) op b);                \
+    } while (false)
+#define UNCHECKED_OP(valueType, op)                         \
+    do {                                                    \
+      double b = AS_NUMBER(tos);                            \
+      top--;                                                \
+      tos = valueType(AS_NUMBER(*top) op b);                \
+    } while (false)
+// Runs a list.h or map.h helper, raising the error it returns.
+#define CONTAINER_OP(call)                                  \
+    do {                                                    \
+      const char* error = (call);                           \
+      if (error != NULL) RAISE_ERROR("%s", error);          \
     } while (false)
 
-
-
+    LOAD_FRAME();
 
     for (;;) {
 #ifdef ALLO_DEBUG_TRACE_EXECUTION
+        STORE_FRAME();
+        flush_output(&vm.output);
         printf("        ");
         for (Value* slot = vm.stack; slot < vm.stackTop; slot++) {
             printf("[ ");
@@ -114,125 +621,546 @@ InterpretResult run() {
         }
         printf("\n");
 
-        disassemble_instruction(vm.chunk, (int)(vm.ip - vm.chunk->code));
+        disassemble_instruction(vm.chunk, (int)(ip - vm.chunk->code));
+#endif
+
+#ifdef ALLO_PROFILE_CYCLES
+        if (untilSample != 0 && --untilSample == 0) {
+            untilSample = profile_sample(vm.profile, (int)(ip - vm.chunk->code));
+        }
 #endif
 
+        executed++;
         uint8_t instruction;
         switch (instruction = READ_BYTE()) {
             case OP_RETURN:
-                return INTERPRET_OK;
+                STORE_FRAME();
+                FINISH(INTERPRET_OK);
+
+            // Stands in for the instruction a budgeted run stops before,
+            // which runs once the run is resumed. Not a finish: the profiler
+            // only counts where a run ends.
+            case OP_YIELD:
+                executed--;
+                ip--;
+                STORE_FRAME();
+                return INTERPRET_YIELD;
 
                 //---- Binary operators
             case OP_NEGATE:
-                if (!IS_NUMBER(peek(0))) {
-                    runtime_error("Operand must be a number.");
-                    return INTERPRET_RUNTIME_ERROR;
+                if (!IS_NUMBER(tos)) {
+                    RAISE_ERROR("Operand must be a number.");
                 }
-                NEGATE(vm.stackTop);
+                QUICKEN(OP_NEGATE_NUM);
+                tos = NUMBER_VAL(-AS_NUMBER(tos));
                 break;
 
 
-            case OP_NIL: push_to_stack(NIL_VAL); break;
-            case OP_TRUE: push_to_stack(BOOL_VAL(true)); break;
-            case OP_FALSE: push_to_stack(BOOL_VAL(false)); break;
+            case OP_NIL: PUSH(NIL_VAL); break;
+            case OP_TRUE: PUSH(BOOL_VAL(true)); break;
+            case OP_FALSE: PUSH(BOOL_VAL(false)); break;
 
-            case OP_ADD: {
-                if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {
-                    concatenate();
-                } else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
-                    double a = AS_NUMBER(pop_stack());
-                    double b = AS_NUMBER(pop_stack());
-                    push_to_stack(NUMBER_VAL(a + b));
+            // A site whose quickened form missed once runs as OP_ADD_GENERIC
+            // from then on instead of flipping between forms.
+            case OP_ADD:
+            case OP_ADD_GENERIC: {
+                if (IS_NUMBER(tos) && IS_NUMBER(top[-1])) {
+                    if (instruction == OP_ADD) QUICKEN(OP_ADD_NUM);
+                    double b = AS_NUMBER(tos);
+                    top--;
+                    tos = NUMBER_VAL(AS_NUMBER(*top) + b);
+                } else if (IS_TEXT(tos) && IS_TEXT(top[-1])) {
+                    if (instruction == OP_ADD) QUICKEN(OP_ADD_STRING);
+                    Value result = concatenate(top[-1], tos);
+                    top--;
+                    tos = result;
                 } else {
-                    runtime_error("Operands must be two numbers or two strings");
-                    return INTERPRET_RUNTIME_ERROR;
+                    RAISE_ERROR("Operands must be two numbers or two strings");
                 }
                 break;
             }
-            case OP_SUBTRACT:   BINARY_OP(NUMBER_VAL, -); break;
-            case OP_MULTIPLY:   BINARY_OP(NUMBER_VAL, *); break;
-            case OP_DIVIDE:     BINARY_OP(NUMBER_VAL, /); break;
+            case OP_SUBTRACT:   BINARY_OP(NUMBER_VAL, -, OP_SUBTRACT_NUM); break;
+            case OP_MULTIPLY:   BINARY_OP(NUMBER_VAL, *, OP_MULTIPLY_NUM); break;
+            case OP_DIVIDE:     BINARY_OP(NUMBER_VAL, /, OP_DIVIDE_NUM); break;
 
-            case OP_NOT: push_to_stack(BOOL_VAL(is_falsey(pop_stack()))); break;
+            case OP_NOT: tos = BOOL_VAL(is_falsey(tos)); break;
             case OP_EQUAL: {
-                Value b = pop_stack();
-                Value a = pop_stack();
-                push_to_stack(BOOL_VAL(values_equal(a, b)));
+                Value b = tos;
+                top--;
+                tos = BOOL_VAL(values_equal(*top, b));
                 break;
             }
             case OP_NOT_EQUAL: {
-                Value b = pop_stack();
-                Value a = pop_stack();
-                push_to_stack(BOOL_VAL(!values_equal(a, b)));
+                Value b = tos;
+                top--;
+                tos = BOOL_VAL(!values_equal(*top, b));
                 break;
             }
 
 
-            case OP_GREATER: BINARY_OP(BOOL_VAL, >); break;
-            case OP_GREATER_EQUAL: BINARY_OP(BOOL_VAL, >=); break;
+            case OP_GREATER: BINARY_OP(BOOL_VAL, >, OP_GREATER_NUM); break;
+            case OP_GREATER_EQUAL: BINARY_OP(BOOL_VAL, >=, OP_GREATER_EQUAL_NUM); break;
 
-            case OP_LESS: BINARY_OP(BOOL_VAL, <); break;
-            case OP_LESS_EQUAL: BINARY_OP(BOOL_VAL, <=); break;
+            case OP_LESS: BINARY_OP(BOOL_VAL, <, OP_LESS_NUM); break;
+            case OP_LESS_EQUAL: BINARY_OP(BOOL_VAL, <=, OP_LESS_EQUAL_NUM); break;
                 //----
             case OP_CONSTANT:
-                Value constant = READ_CONSTANT();
-                push_to_stack(constant);
+                PUSH(READ_CONSTANT());
                 break;
 
                 //---
             case OP_PRINT:
-                print_value(pop_stack());
-                printf("\n");
+                write_value(&vm.output, tos);
+                write_output_char(&vm.output, '\n');
+                DROP();
                 break;
-            case OP_POP: pop_stack(); break;
+            case OP_POP: DROP(); break;
+            case OP_DUP: PUSH(tos); break;
             case OP_DEFINE_GLOBAL: {
                 ObjString* name = READ_STRING();
-                table_set(&vm.globals, name, peek(0));
-                pop_stack();
+                table_set(&vm.globals, name, tos);
+                DROP();
                 break;
             }
             case OP_GET_GLOBAL: {
                 ObjString* name = READ_STRING();
                 Value value;
                 if (!table_get(&vm.globals, name, &value)) {
-                    runtime_error("Undefined variable '%s'.", name->chars);
-                    return INTERPRET_RUNTIME_ERROR;
+                    RAISE_ERROR("Undefined variable '%s'.", name->chars);
                 }
-                push_to_stack(value);
+                PUSH(value);
                 break;
             }
             case OP_SET_GLOBAL: {
                 ObjString* name = READ_STRING();
-                if (table_set(&vm.globals, name, peek(0))) {
+                if (table_set(&vm.globals, name, tos)) {
                     table_delete(&vm.globals, name);
-                    runtime_error("Undefined variable '%s'.", name->chars);
-                    return INTERPRET_RUNTIME_ERROR;
+                    RAISE_ERROR("Undefined variable '%s'.", name->chars);
                 }
                 break;
             }
             case OP_GET_LOCAL: {
+                // PUSH stores the old top before reading, so this also sees
+                // a local that is itself the current top.
                 uint8_t slot = READ_BYTE();
-                push_to_stack(vm.stack[slot]);
+                PUSH(slots[slot]);
                 break;
             }
             case OP_SET_LOCAL: {
                 uint8_t slot = READ_BYTE();
-                vm.stack[slot] = peek(0);
+                slots[slot] = tos;
                 break;
             }
 
 
+                //---- Lists
+            case OP_NEW_LIST:
+                PUSH(OBJ_VAL(new_list(READ_BYTE())));
+                break;
+            case OP_APPEND:
+                CONTAINER_OP(list_append(top[-1], tos));
+                DROP();
+                break;
+            case OP_GET_INDEX: {
+                Value element;
+                CONTAINER_OP(index_get(top[-1], tos, &element));
+                top--;
+                tos = element;
+                break;
+            }
+            case OP_SET_INDEX:
+                CONTAINER_OP(index_set(top[-2], top[-1], tos));
+                top -= 2;
+                break;
+            case OP_LEN: CONTAINER_OP(builtin_len(tos, &tos)); break;
+            case OP_SUM: CONTAINER_OP(builtin_sum(tos, &tos)); break;
+            case OP_MIN: CONTAINER_OP(builtin_min(tos, &tos)); break;
+            case OP_MAX: CONTAINER_OP(builtin_max(tos, &tos)); break;
+            case OP_DOT: {
+                Value dot;
+                CONTAINER_OP(builtin_dot(top[-1], tos, &dot));
+                top--;
+                tos = dot;
+                break;
+            }
+
+                //---- Maps
+            case OP_NEW_MAP:
+                PUSH(OBJ_VAL(new_map(READ_BYTE())));
+                break;
+            case OP_ADD_ENTRY:
+                CONTAINER_OP(map_add_entry(top[-2], top[-1], tos));
+                top -= 2;
+                tos = *top;
+                break;
+            case OP_DELETE: {
+                Value deleted;
+                CONTAINER_OP(map_delete(top[-1], tos, &deleted));
+                top--;
+                tos = deleted;
+                break;
+            }
+            case OP_GET_DEFAULT: {
+                Value value;
+                CONTAINER_OP(map_get_default(top[-2], top[-1], tos, &value));
+                top -= 2;
+                tos = value;
+                break;
+            }
+
+                //---- Strings
+            case OP_SLICE: {
+                Value slice;
+                CONTAINER_OP(text_slice(top[-2], top[-1], tos, &slice));
+                top -= 2;
+                tos = slice;
+                break;
+            }
+            case OP_SPLIT: {
+                Value pieces;
+                CONTAINER_OP(builtin_split(top[-1], tos, &pieces));
+                top--;
+                tos = pieces;
+                break;
+            }
+            case OP_FIND: {
+                Value index;
+                CONTAINER_OP(builtin_find(top[-1], tos, &index));
+                top--;
+                tos = index;
+                break;
+            }
+
+                //---- Quickened
+            case OP_ADD_NUM:
+                if (!IS_NUMBER(tos) || !IS_NUMBER(top[-1])) DEOPTIMIZE(OP_ADD_GENERIC);
+                quickenedHits++;
+                UNCHECKED_OP(NUMBER_VAL, +);
+                break;
+            case OP_SUBTRACT_NUM:       NUMBER_OP(NUMBER_VAL, -); break;
+            case OP_MULTIPLY_NUM:       NUMBER_OP(NUMBER_VAL, *); break;
+            case OP_DIVIDE_NUM:         NUMBER_OP(NUMBER_VAL, /); break;
+            case OP_GREATER_NUM:        NUMBER_OP(BOOL_VAL, >); break;
+            case OP_GREATER_EQUAL_NUM:  NUMBER_OP(BOOL_VAL, >=); break;
+            case OP_LESS_NUM:           NUMBER_OP(BOOL_VAL, <); break;
+            case OP_LESS_EQUAL_NUM:     NUMBER_OP(BOOL_VAL, <=); break;
+            case OP_NEGATE_NUM:
+                if (!IS_NUMBER(tos)) GUARD_FAILED("Operand must be a number.");
+                quickenedHits++;
+                tos = NUMBER_VAL(-AS_NUMBER(tos));
+                break;
+            case OP_ADD_STRING: {
+                if (!IS_TEXT(tos) || !IS_TEXT(top[-1])) DEOPTIMIZE(OP_ADD_GENERIC);
+                quickenedHits++;
+                Value result = concatenate(top[-1], tos);
+                top--;
+                tos = result;
+                break;
+            }
+
+                //---- Proven numeric by the compiler
+            case OP_ADD_UNCHECKED:            UNCHECKED_OP(NUMBER_VAL, +); break;
+            case OP_SUBTRACT_UNCHECKED:       UNCHECKED_OP(NUMBER_VAL, -); break;
+            case OP_MULTIPLY_UNCHECKED:       UNCHECKED_OP(NUMBER_VAL, *); break;
+            case OP_DIVIDE_UNCHECKED:         UNCHECKED_OP(NUMBER_VAL, /); break;
+            case OP_GREATER_UNCHECKED:        UNCHECKED_OP(BOOL_VAL, >); break;
+            case OP_GREATER_EQUAL_UNCHECKED:  UNCHECKED_OP(BOOL_VAL, >=); break;
+            case OP_LESS_UNCHECKED:           UNCHECKED_OP(BOOL_VAL, <); break;
+            case OP_LESS_EQUAL_UNCHECKED:     UNCHECKED_OP(BOOL_VAL, <=); break;
+            case OP_NEGATE_UNCHECKED: tos = NUMBER_VAL(-AS_NUMBER(tos)); break;
+
             default:
-                return INTERPRET_COMPILE_ERROR;
+                STORE_FRAME();
+                FINISH(INTERPRET_COMPILE_ERROR);
         }
     }
 
-#undef BINARY_OPERATOR
+#undef LOAD_FRAME
+#undef STORE_FRAME
+#undef FINISH
+#undef PUSH
+#undef DROP
+#undef RAISE_ERROR
+#undef QUICKEN
+#undef DEOPTIMIZE
+#undef GUARD_FAILED
+#undef BINARY_OP
+#undef NUMBER_OP
+#undef UNCHECKED_OP
+#undef CONTAINER_OP
 #undef READ_BYTE
 #undef READ_STRING
 #undef READ_CONSTANT
 }
 
+Value* execute_instruction(Value* top, uint8_t* ip) {
+    vm.stackTop = top;
+    vm.ip = ip;
+
+#define RAISE_ERROR(...)                                    \
+    do {                                                    \
+        runtime_error(__VA_ARGS__);                         \
+        return NULL;                                        \
+    } while (false)
+#define READ_STRING() AS_STRING(vm.chunk->constants.values[*ip])
+#define CONTAINER_OP(call)                                  \
+    do {                                                    \
+        const char* error = (call);                         \
+        if (error != NULL) RAISE_ERROR("%s", error);        \
+    } while (false)
+
+    switch (ip[-1]) {
+        case OP_NEGATE:
+        case OP_NEGATE_NUM:
+            if (!IS_NUMBER(top[-1])) RAISE_ERROR("Operand must be a number.");
+            top[-1] = NUMBER_VAL(-AS_NUMBER(top[-1]));
+            return top;
+
+        case OP_ADD:
+        case OP_ADD_NUM:
+        case OP_ADD_STRING:
+        case OP_ADD_GENERIC:
+            if (IS_NUMBER(top[-1]) && IS_NUMBER(top[-2])) {
+                top[-2] = NUMBER_VAL(AS_NUMBER(top[-2]) + AS_NUMBER(top[-1]));
+            } else if (IS_TEXT(top[-1]) && IS_TEXT(top[-2])) {
+                top[-2] = concatenate(top[-2], top[-1]);
+            } else {
+                RAISE_ERROR("Operands must be two numbers or two strings");
+            }
+            return top - 1;
+
+        case OP_SUBTRACT:
+        case OP_SUBTRACT_NUM:
+        case OP_MULTIPLY:
+        case OP_MULTIPLY_NUM:
+        case OP_DIVIDE:
+        case OP_DIVIDE_NUM:
+        case OP_GREATER:
+        case OP_GREATER_NUM:
+        case OP_GREATER_EQUAL:
+        case OP_GREATER_EQUAL_NUM:
+        case OP_LESS:
+        case OP_LESS_NUM:
+        case OP_LESS_EQUAL:
+        case OP_LESS_EQUAL_NUM:
+            // Native code only calls out for these once the operands turned
+            // out not to be numbers.
+            RAISE_ERROR("Operands must be numbers.");
+
+        case OP_NOT:
+            top[-1] = BOOL_VAL(is_falsey(top[-1]));
+            return top;
+        case OP_EQUAL:
+            top[-2] = BOOL_VAL(values_equal(top[-2], top[-1]));
+            return top - 1;
+        case OP_NOT_EQUAL:
+            top[-2] = BOOL_VAL(!values_equal(top[-2], top[-1]));
+            return top - 1;
+
+        case OP_PRINT:
+            write_value(&vm.output, top[-1]);
+            write_output_char(&vm.output, '\n');
+            return top - 1;
+        case OP_DEFINE_GLOBAL:
+            table_set(&vm.globals, READ_STRING(), top[-1]);
+            return top - 1;
+        case OP_GET_GLOBAL: {
+            ObjString* name = READ_STRING();
+            if (!table_get(&vm.globals, name, top)) {
+                RAISE_ERROR("Undefined variable '%s'.", name->chars);
+            }
+            return top + 1;
+        }
+        case OP_SET_GLOBAL: {
+            ObjString* name = READ_STRING();
+            if (table_set(&vm.globals, name, top[-1])) {
+                table_delete(&vm.globals, name);
+                RAISE_ERROR("Undefined variable '%s'.", name->chars);
+            }
+            return top;
+        }
+
+        case OP_NEW_LIST:
+            top[0] = OBJ_VAL(new_list(*ip));
+            return top + 1;
+        case OP_APPEND:
+            CONTAINER_OP(list_append(top[-2], top[-1]));
+            return top - 1;
+        case OP_GET_INDEX:
+            CONTAINER_OP(index_get(top[-2], top[-1], &top[-2]));
+            return top - 1;
+        case OP_SET_INDEX:
+            CONTAINER_OP(index_set(top[-3], top[-2], top[-1]));
+            top[-3] = top[-1];
+            return top - 2;
+        case OP_LEN: CONTAINER_OP(builtin_len(top[-1], &top[-1])); return top;
+        case OP_SUM: CONTAINER_OP(builtin_sum(top[-1], &top[-1])); return top;
+        case OP_MIN: CONTAINER_OP(builtin_min(top[-1], &top[-1])); return top;
+        case OP_MAX: CONTAINER_OP(builtin_max(top[-1], &top[-1])); return top;
+        case OP_DOT:
+            CONTAINER_OP(builtin_dot(top[-2], top[-1], &top[-2]));
+            return top - 1;
+
+        case OP_NEW_MAP:
+            top[0] = OBJ_VAL(new_map(*ip));
+            return top + 1;
+        case OP_ADD_ENTRY:
+            CONTAINER_OP(map_add_entry(top[-3], top[-2], top[-1]));
+            return top - 2;
+        case OP_DELETE:
+            CONTAINER_OP(map_delete(top[-2], top[-1], &top[-2]));
+            return top - 1;
+        case OP_GET_DEFAULT:
+            CONTAINER_OP(map_get_default(top[-3], top[-2], top[-1], &top[-3]));
+            return top - 2;
+
+        case OP_SLICE:
+            CONTAINER_OP(text_slice(top[-3], top[-2], top[-1], &top[-3]));
+            return top - 2;
+        case OP_SPLIT:
+            CONTAINER_OP(builtin_split(top[-2], top[-1], &top[-2]));
+            return top - 1;
+        case OP_FIND:
+            CONTAINER_OP(builtin_find(top[-2], top[-1], &top[-2]));
+            return top - 1;
+
+        default:
+            RAISE_ERROR("Unexpected instruction %d in native code.", ip[-1]);
+    }
+
+#undef RAISE_ERROR
+#undef READ_STRING
+#undef CONTAINER_OP
+}
+
+InterpretResult run_registers(RegisterChunk* chunk) {
+    // The register file lives in the VM's stack: the slots first, then a copy
+    // of the constants, nil, true and false, so operands never need to say
+    // where they come from.
+    ensure_stack_capacity((int)(vm.stackTop - vm.stack) + chunk->registerCount);
+    Value* registers = vm.stackTop;
+    Value* constants = registers + chunk->slotCount;
+    memcpy(constants, chunk->constants->values, sizeof(Value) * chunk->constants->count);
+    constants[chunk->constants->count] = NIL_VAL;
+    constants[chunk->constants->count + 1] = BOOL_VAL(true);
+    constants[chunk->constants->count + 2] = BOOL_VAL(false);
+
+    RegisterInstruction* ip = chunk->code;
+
+#define A (registers[instruction.a])
+#define B (registers[instruction.b])
+#define C (registers[instruction.c])
+// Every instruction up to `ip` ran: there are no jumps.
+#define FINISH(result)                                                      \
+    do {                                                                    \
+        vm.metrics.instructions += (uint64_t)(ip - chunk->code);            \
+        return result;                                                      \
+    } while (false)
+#define RAISE_ERROR(...)                                                    \
+    do {                                                                    \
+        runtime_error_at(chunk->lines[ip - chunk->code - 1], __VA_ARGS__); \
+        FINISH(INTERPRET_RUNTIME_ERROR);                                    \
+    } while (false)
+#define BINARY_OP(valueType, op)                                            \
+    do {                                                                    \
+        if (!IS_NUMBER(B) || !IS_NUMBER(C)) {                               \
+            RAISE_ERROR("Operands must be numbers.");                       \
+        }                                                                   \
+        A = valueType(AS_NUMBER(B) op AS_NUMBER(C));                        \
+    } while (false)
+#define UNCHECKED_OP(valueType, op) (A = valueType(AS_NUMBER(B) op AS_NUMBER(C)))
+
+    for (;;) {
+        RegisterInstruction instruction = *ip++;
+        switch (instruction.op) {
+            case ROP_MOVE: A = B; break;
+
+            case ROP_ADD:
+                if (IS_NUMBER(B) && IS_NUMBER(C)) {
+                    A = NUMBER_VAL(AS_NUMBER(B) + AS_NUMBER(C));
+                } else if (IS_TEXT(B) && IS_TEXT(C)) {
+                    A = concatenate(B, C);
+                } else {
+                    RAISE_ERROR("Operands must be two numbers or two strings");
+                }
+                break;
+            case ROP_SUBTRACT:      BINARY_OP(NUMBER_VAL, -); break;
+            case ROP_MULTIPLY:      BINARY_OP(NUMBER_VAL, *); break;
+            case ROP_DIVIDE:        BINARY_OP(NUMBER_VAL, /); break;
+            case ROP_GREATER:       BINARY_OP(BOOL_VAL, >); break;
+            case ROP_GREATER_EQUAL: BINARY_OP(BOOL_VAL, >=); break;
+            case ROP_LESS:          BINARY_OP(BOOL_VAL, <); break;
+            case ROP_LESS_EQUAL:    BINARY_OP(BOOL_VAL, <=); break;
+            case ROP_NEGATE:
+                if (!IS_NUMBER(B)) RAISE_ERROR("Operand must be a number.");
+                A = NUMBER_VAL(-AS_NUMBER(B));
+                break;
+
+            case ROP_ADD_UNCHECKED:           UNCHECKED_OP(NUMBER_VAL, +); break;
+            case ROP_SUBTRACT_UNCHECKED:      UNCHECKED_OP(NUMBER_VAL, -); break;
+            case ROP_MULTIPLY_UNCHECKED:      UNCHECKED_OP(NUMBER_VAL, *); break;
+            case ROP_DIVIDE_UNCHECKED:        UNCHECKED_OP(NUMBER_VAL, /); break;
+            case ROP_GREATER_UNCHECKED:       UNCHECKED_OP(BOOL_VAL, >); break;
+            case ROP_GREATER_EQUAL_UNCHECKED: UNCHECKED_OP(BOOL_VAL, >=); break;
+            case ROP_LESS_UNCHECKED:          UNCHECKED_OP(BOOL_VAL, <); break;
+            case ROP_LESS_EQUAL_UNCHECKED:    UNCHECKED_OP(BOOL_VAL, <=); break;
+            case ROP_NEGATE_UNCHECKED:        A = NUMBER_VAL(-AS_NUMBER(B)); break;
+
+            case ROP_EQUAL:     A = BOOL_VAL(values_equal(B, C)); break;
+            case ROP_NOT_EQUAL: A = BOOL_VAL(!values_equal(B, C)); break;
+            case ROP_NOT:       A = BOOL_VAL(is_falsey(B)); break;
+
+            case ROP_GET_GLOBAL: {
+                ObjString* name = AS_STRING(B);
+                if (!table_get(&vm.globals, name, &A)) {
+                    RAISE_ERROR("Undefined variable '%s'.", name->chars);
+                }
+                break;
+            }
+            case ROP_SET_GLOBAL: {
+                ObjString* name = AS_STRING(A);
+                if (table_set(&vm.globals, name, B)) {
+                    table_delete(&vm.globals, name);
+                    RAISE_ERROR("Undefined variable '%s'.", name->chars);
+                }
+                break;
+            }
+            case ROP_DEFINE_GLOBAL:
+                table_set(&vm.globals, AS_STRING(A), B);
+                break;
+            case ROP_PRINT:
+                write_value(&vm.output, A);
+                write_output_char(&vm.output, '\n');
+                break;
+            case ROP_RETURN:
+                FINISH(INTERPRET_OK);
+
+            default:
+                FINISH(INTERPRET_COMPILE_ERROR);
+        }
+    }
+
+#undef A
+#undef B
+#undef C
+#undef FINISH
+#undef RAISE_ERROR
+#undef BINARY_OP
+#undef UNCHECKED_OP
+}
+
+void reset_vm() {
+    reset_stack();
+    free_table(&vm.globals);
+    free_table(&vm.strings);
+    free_objects();
+    vm.objects = NULL;
+}
+
+void define_global(const char* name, Value value) {
+    table_set(&vm.globals, copy_string(name, (int)strlen(name)), value);
+}
+
 void reset_stack() {
     vm.stackTop = vm.stack;
 }
@@ -240,12 +1168,6 @@ void reset_stack() {
 void push_to_stack(Value value) {
     *vm.stackTop = value;
     vm.stackTop++;
-
-
-    //todo implement  proper  stack overflow warnings / errors;
-    if (vm.stackTop - vm.stack >= STACK_MAX) {
-        printf("[WARNING] STACK IS OVERFLOWING\n");
-    }
 }
 
 
@@ -1,40 +1,183 @@
 #ifndef allo_vm_h
 #define allo_vm_h
 
+#include <setjmp.h>
+#include <stdatomic.h>
+
 #include "chunk.h"
+#include "jit.h"
+#include "metrics.h"
+#include "output.h"
+#include "profile.h"
+#include "program.h"
+#include "register_chunk.h"
 #include "table.h"
 
-#define STACK_MAX 256
+// The stack starts at this size and grows to fit each chunk's maxStack.
+#define STACK_INITIAL_CAPACITY 256
+
 
 
+typedef enum {
+    BACKEND_STACK,
+    BACKEND_REGISTER,   // translates each chunk to register code first
+    BACKEND_JIT,        // compiles each chunk to native code first
+} Backend;
+
+// How often the quickened instructions' type guards held.
+typedef struct {
+    uint64_t quickened;     // generic instructions rewritten to a specialized form
+    uint64_t hits;          // specialized instructions whose guard held
+    uint64_t misses;        // guard failures; only OP_ADD sites go generic, for good
+} QuickeningStats;
 
-//todo support multiple virtual machines?
+// Each thread gets its own VM, so separate threads can execute a shared
+// Program concurrently.
 typedef struct {
     Chunk* chunk;
     uint8_t* ip; // instruction pointer
-    Value stack[STACK_MAX];
+    Value* stack;
     Value* stackTop;
+    int stackCapacity;
     Table strings;
     Table globals;
     Obj* objects;
+
+    // The program this VM is bound to and its frozen constant strings, which
+    // are checked before vm.strings when interning. boundChunk shares the
+    // program's constants and lines but has its own copy of the bytecode,
+    // since quickening rewrites instructions in place. boundRegisters is the
+    // program translated to register code when bound under BACKEND_REGISTER,
+    // boundJit its native code when bound under BACKEND_JIT.
+    Program* program;
+    Table* frozenStrings;
+    Chunk boundChunk;
+    RegisterChunk boundRegisters;
+    JitCode boundJit;
+    // Offsets into boundChunk of every DEADLINE_CHECK_INTERVAL-th
+    // instruction, where a run of it stops to check for an interrupt. Found
+    // by the first such run; boundStopCount is -1 until then.
+    int* boundStops;
+    int boundStopCount;
+
+    Backend backend;
+
+    QuickeningStats quickening;
+    Metrics metrics;
+
+    // Filled in by run() when set. Only the stack interpreter is profiled.
+    Profile* profile;
+
+    // Where OP_PRINT writes; stdout unless the host reconfigures it.
+    OutputBuffer output;
+
+    // Between begin_program() and the end of the run run_budget() steps
+    // through.
+    bool suspended;
+
+    // This VM's interrupt flag, allocated so its address stays put however
+    // the VM is swapped around. `interruptible` is set once interrupt_flag()
+    // has handed it out, and `interrupted` by poll_interrupt() for the run it
+    // unwinds.
+    atomic_bool* interrupt;
+    bool interruptible;
+    bool interrupted;
+
+    // Where every allocation made while this VM is in the thread's slot
+    // comes from, and the bytes it may hold at once (0 for no limit).
+    // out_of_memory() unwinds to `recover` when set, which run_protected()
+    // does around every run.
+    Allocator allocator;
+    size_t memoryLimit;
+    size_t memoryUsed;
+    jmp_buf* recover;
 } VM;
 
+// How many instructions run between checks of run_budget()'s deadline or of
+// the interrupt flag.
+#define DEADLINE_CHECK_INTERVAL 1024
+
 typedef enum {
     INTERPRET_OK,
     INTERPRET_COMPILE_ERROR,
     INTERPRET_RUNTIME_ERROR,
+    INTERPRET_YIELD,        // run_budget() stopped early; call it again to resume
+    INTERPRET_TIMEOUT,      // stopped by interrupt_flag(), with the stack cleared
 } InterpretResult;
 
-extern VM vm;
+extern _Thread_local VM vm;
 
 
+// Keeps vm.allocator and vm.memoryLimit, so a host can set them first.
 void init_vm();
 void free_vm();
 
+void configure_output(int capacity, FlushPolicy policy);
+// Sends OP_PRINT output to `file` instead, keeping the buffer settings.
+void set_output_file(FILE* file);
+// Takes effect for the next chunk run or program bound.
+void select_backend(Backend backend);
+// Starts counting into `profile`, or stops when NULL. The profile has to stay
+// alive while set.
+void set_profile(Profile* profile);
+QuickeningStats get_quickening_stats();
+Metrics get_metrics();
+
+// The chunk's maxStack must cover its deepest point; compile() sets it.
 InterpretResult interpret_chunk(Chunk* chunk);
 InterpretResult interpret_code(const char* source);
+// Binding the VM to a different program than last time clears its globals.
+void bind_program(Program* program);
+InterpretResult interpret_program(Program* program);
+// Sets up a run of `program` for run_budget() to execute a slice at a time,
+// binding the VM to it first if needed. Budgeted runs always use the stack
+// interpreter. Returns false, having reported it, when out of memory.
+bool begin_program(Program* program);
+// Continues the run begun by begin_program() for at most `instructions` more
+// instructions and, unless `deadline` is 0, until about that trace_clock()
+// time. Returns INTERPRET_YIELD when it stops early, with the run's state left
+// in the VM for the next call to resume; otherwise how the run ended.
+// Returns INTERPRET_OK when there is no run to continue.
+InterpretResult run_budget(uint64_t instructions, uint64_t deadline);
+// The interrupt flag of the VM in the calling thread's slot, which init_vm()
+// has to have set up. From then on the stack interpreter runs in slices of
+// DEADLINE_CHECK_INTERVAL instructions, checking the flag between them, and
+// helpers whose work grows with their input check it as they go. Setting the
+// flag, from any thread or a signal handler, stops the VM's run in progress,
+// or its next one, with INTERPRET_TIMEOUT and drops the output it still has
+// buffered. The flag is cleared when that run ends, however it ends.
+atomic_bool* interrupt_flag();
+// Unwinds the run in progress when its VM has been interrupted. Called by the
+// helpers behind OP_ADD on strings and the builtins, whose cost grows with
+// their input rather than with the script's length.
+void poll_interrupt();
+// Exchanges the calling thread's VM with *other, for hosts that keep several
+// VMs and switch between them on one thread. A VM only ever runs in the
+// thread's own slot, so pointers into it such as vm.chunk stay right.
+void swap_vm(VM* other);
+
+// Calls body(context) with vm.recover set, so running out of memory inside it
+// returns false here instead of exiting. Whatever body was in the middle of
+// is abandoned; allocations are ordered so that leaves the VM consistent.
+bool run_protected(void (*body)(void* context), void* context);
+
+// Drops everything a previous run left behind (stack, globals and the strings
+// it created) while keeping the bound program.
+void reset_vm();
+void define_global(const char* name, Value value);
 
 InterpretResult run();
+InterpretResult run_registers(RegisterChunk* chunk);
+// Runs the instruction ending just before `ip` in vm.chunk on the stack ending
+// at `top`, for native code that has no template of its own for it. Returns
+// the new stack top, or NULL after reporting a runtime error.
+Value* execute_instruction(Value* top, uint8_t* ip);
+
+// The pieces of the interpreter that code generated by --emit-c calls into.
+// runtime_error_at() reports an error on `line` and resets the stack.
+// Either side may be a string or a view.
+Value concatenate(Value a, Value b);
+void runtime_error_at(int line, const char* format, ...);
 
 void reset_stack();
 void push_to_stack(Value value);
@@ -0,0 +1,201 @@
+// clock_gettime() is POSIX, not C11.
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Allo/compiler.h"
+#include "Allo/program.h"
+#include "Allo/virtual_machine.h"
+
+// Runs each workload script RUNS times in-process, compiled once and executed
+// the way --per-record executes it for every record, and reports the median
+// and 99th percentile wall time of a single run plus instructions per second.
+// The table goes to stderr and the JSON, one workload per line so two reports
+// diff cleanly, to stdout or the --json file.
+//
+// usage: allo_bench [-O0 | -O1 | -O2] [--registers | --jit] [--runs N]
+//                   [--json file] workload.allo...
+
+#define DEFAULT_RUNS 1000
+#define WARMUP_RUNS 10
+
+typedef struct {
+    const char* name;
+    uint64_t medianNs;
+    uint64_t p99Ns;
+    uint64_t instructionsPerRun;
+    double instructionsPerSecond;
+} Result;
+
+static void usage() {
+    fprintf(stderr, "Usage: allo_bench [-O0 | -O1 | -O2] [--registers | --jit] [--runs N]\n"
+                    "                  [--json file] workload.allo...\n");
+    exit(INVALID_CMD_ARGUMENTS);
+}
+
+static char* read_file(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\" \n", path);
+        exit(SOURCE_FILE_READING_ERROR);
+    }
+
+    fseek(file, 0L, SEEK_END);
+    size_t fileSize = ftell(file);
+    rewind(file);
+
+    char* buffer = (char*)malloc(fileSize + 1);
+    if (buffer == NULL || fread(buffer, sizeof(char), fileSize, file) != fileSize) {
+        fprintf(stderr, "Could not read file \"%s\" \n", path);
+        exit(SOURCE_FILE_READING_ERROR);
+    }
+    buffer[fileSize] = '\0';
+
+    fclose(file);
+    return buffer;
+}
+
+static uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static int compare_times(const void* a, const void* b) {
+    uint64_t left = *(const uint64_t*)a;
+    uint64_t right = *(const uint64_t*)b;
+    return (left > right) - (left < right);
+}
+
+// The sample below which `percent` of the sorted samples fall.
+static uint64_t percentile(const uint64_t* sorted, int count, int percent) {
+    int index = (int)(((int64_t)count * percent + 99) / 100) - 1;
+    return sorted[index < 0 ? 0 : index];
+}
+
+static bool run_once(Program* program) {
+    reset_vm();
+    return interpret_program(program) == INTERPRET_OK;
+}
+
+static Result measure(const char* path, int runs, uint64_t* times) {
+    char* source = read_file(path);
+    Program* program = compile_program(source);
+    free(source);
+
+    if (program == NULL) exit(COMPILER_ERROR);
+
+    bind_program(program);
+    for (int i = 0; i < WARMUP_RUNS; i++) {
+        if (!run_once(program)) exit(RUNTIME_ERROR);
+    }
+
+    uint64_t instructions = vm.metrics.instructions;
+    uint64_t total = 0;
+    for (int i = 0; i < runs; i++) {
+        uint64_t start = now_ns();
+        bool ok = run_once(program);
+        times[i] = now_ns() - start;
+        if (!ok) exit(RUNTIME_ERROR);
+        total += times[i];
+    }
+    instructions = vm.metrics.instructions - instructions;
+
+    release_program(program);
+
+    qsort(times, runs, sizeof(uint64_t), compare_times);
+
+    const char* name = strrchr(path, '/');
+    Result result;
+    result.name = name == NULL ? path : name + 1;
+    result.medianNs = percentile(times, runs, 50);
+    result.p99Ns = percentile(times, runs, 99);
+    result.instructionsPerRun = instructions / runs;
+    result.instructionsPerSecond = total == 0 ? 0.0 : (double)instructions * 1e9 / (double)total;
+    return result;
+}
+
+static void write_json(const Result* results, int count, int runs, FILE* out) {
+    fprintf(out, "{\"runs\": %d, \"workloads\": [\n", runs);
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "  {\"name\": \"%s\", \"median_ns\": %llu, \"p99_ns\": %llu, "
+                     "\"instructions_per_run\": %llu, \"instructions_per_second\": %.0f}%s\n",
+                results[i].name, (unsigned long long)results[i].medianNs,
+                (unsigned long long)results[i].p99Ns, (unsigned long long)results[i].instructionsPerRun,
+                results[i].instructionsPerSecond, i + 1 < count ? "," : "");
+    }
+    fprintf(out, "]}\n");
+}
+
+int main(int argc, const char* argv[]) {
+    int runs = DEFAULT_RUNS;
+    const char* jsonPath = NULL;
+    Backend backend = BACKEND_STACK;
+    const char** paths = malloc(sizeof(const char*) * argc);
+    int pathCount = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+            if (runs <= 0) usage();
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (strcmp(argv[i], "--registers") == 0) {
+            backend = BACKEND_REGISTER;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            backend = BACKEND_JIT;
+        } else if (strcmp(argv[i], "-O0") == 0) {
+            set_optimization_level(0);
+        } else if (strcmp(argv[i], "-O1") == 0) {
+            set_optimization_level(1);
+        } else if (strcmp(argv[i], "-O2") == 0) {
+            set_optimization_level(2);
+        } else if (argv[i][0] == '-') {
+            usage();
+        } else {
+            paths[pathCount++] = argv[i];
+        }
+    }
+
+    if (pathCount == 0) usage();
+
+    // Scripts print; only the interpreter's time is of interest.
+    FILE* discard = fopen("/dev/null", "w");
+    if (discard == NULL) {
+        fprintf(stderr, "Could not open /dev/null\n");
+        exit(SOURCE_FILE_READING_ERROR);
+    }
+
+    init_vm();
+    select_backend(backend);
+    set_output_file(discard);
+
+    Result* results = malloc(sizeof(Result) * pathCount);
+    uint64_t* times = malloc(sizeof(uint64_t) * runs);
+    fprintf(stderr, "%-24s %12s %12s %12s %14s\n", "workload", "median us", "p99 us", "ins/run", "Mins/s");
+    for (int i = 0; i < pathCount; i++) {
+        results[i] = measure(paths[i], runs, times);
+        fprintf(stderr, "%-24s %12.2f %12.2f %12llu %14.1f\n", results[i].name,
+                results[i].medianNs / 1e3, results[i].p99Ns / 1e3,
+                (unsigned long long)results[i].instructionsPerRun, results[i].instructionsPerSecond / 1e6);
+    }
+
+    free_vm();
+    fclose(discard);
+
+    FILE* out = stdout;
+    if (jsonPath != NULL && (out = fopen(jsonPath, "w")) == NULL) {
+        fprintf(stderr, "Could not open file \"%s\" \n", jsonPath);
+        exit(SOURCE_FILE_READING_ERROR);
+    }
+    write_json(results, pathCount, runs, out);
+    if (out != stdout) fclose(out);
+
+    free(times);
+    free(results);
+    free(paths);
+    return 0;
+}
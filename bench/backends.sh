@@ -0,0 +1,54 @@
+#!/bin/sh
+# Compares the stack, register and JIT backends on every workload in this
+# directory: instructions executed per run and the best wall time over RUNS
+# runs, each executing the script once per record for RECORDS records so
+# process startup doesn't dominate.
+#
+# usage: bench/backends.sh path/to/AlloLanguage [RUNS] [RECORDS] [-O0|-O1|-O2]
+#
+# Scripts have no loops or calls, so every instruction runs exactly once and
+# the instruction count is just the length of the disassembly.
+
+allo=${1:?usage: backends.sh path/to/AlloLanguage [runs] [records] [-O0|-O1|-O2]}
+runs=${2:-10}
+records=${3:-10000}
+level=${4:--O0}
+dir=$(dirname "$0")
+input=$(mktemp)
+trap 'rm -f "$input"' EXIT
+yes record | head -n "$records" > "$input"
+
+now_ns() {
+    date +%s%N
+}
+
+best_ms() {
+    best=
+    i=0
+    while [ "$i" -lt "$runs" ]; do
+        start=$(now_ns)
+        "$allo" "$level" --per-record "$@" < "$input" > /dev/null || exit 1
+        elapsed=$(( $(now_ns) - start ))
+        if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then best=$elapsed; fi
+        i=$((i + 1))
+    done
+    echo "$((best / 1000000)) ms"
+}
+
+stack_count() {
+    "$allo" "$level" --dump-bytecode "$1" | grep -c '^[0-9]'
+}
+
+register_count() {
+    "$allo" "$level" --registers --dump-bytecode "$1" |
+        sed -n '/(registers)/,$p' | grep -c '^[0-9]'
+}
+
+printf '%-24s %10s %12s %10s %12s %12s\n' workload "stack ins" "stack time" "reg ins" "reg time" \
+    "jit time"
+for script in "$dir"/*.allo; do
+    printf '%-24s %10s %12s %10s %12s %12s\n' "$(basename "$script")" \
+        "$(stack_count "$script")" "$(best_ms "$script")" \
+        "$(register_count "$script")" "$(best_ms --registers "$script")" \
+        "$(best_ms --jit "$script")"
+done
@@ -0,0 +1,503 @@
+// clock_gettime() isn't C11.
+#define _DEFAULT_SOURCE
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Allo/allo.h"
+#include "Allo/compiler.h"
+#include "Allo/program.h"
+#include "Allo/scanner.h"
+#include "Allo/virtual_machine.h"
+
+// Measures the front end on its own. Generates a synthetic source of about
+// --size megabytes from a tunable mix of literals, identifier-heavy
+// arithmetic, nested blocks, long strings and comments, then times one stage:
+//
+//   scan     scan_token() over the source until TOKEN_EOF
+//   compile  compile_program(), scanner included
+//   full     compile_program() and running the result once
+//
+// A chunk holds at most 256 constants and every literal, string and global
+// reference takes one, so no single valid script gets anywhere near 100 MB.
+// The source is generated as a run of independent scripts ("units") of about
+// UNIT_BYTES each, every one valid and runnable on its own, and each stage
+// goes through them in turn. --emit writes them out instead, one after another
+// behind a `// unit N` line.
+//
+// Peak memory is the most the runtime held at once above what the VM held
+// before the stage started, counted through the VM's allocator. The generated
+// source isn't part of it, so it tracks the front end's own memory however
+// large --size is. The table goes to stderr and the JSON to stdout or the
+// --json file.
+//
+// usage: frontend_bench [--mode scan|compile|full] [--size MB] [--seed N]
+//                       [--literals W] [--identifiers W] [--blocks W]
+//                       [--strings W] [--comments W] [--string-length N]
+//                       [--max-depth N] [-O0 | -O1 | -O2] [--json file | --emit]
+
+#define UNIT_BYTES (64 * 1024)
+// Below UINT8_COUNT, leaving room for the most any one statement adds.
+#define UNIT_CONSTANTS 240
+#define STATEMENT_CONSTANTS 4
+#define BLOCK_LOCALS 8
+#define MAX_DEPTH_LIMIT 24
+#define COMMENT_LENGTH 60
+
+typedef enum {
+    ITEM_LITERAL,
+    ITEM_IDENTIFIER,
+    ITEM_BLOCK,
+    ITEM_STRING,
+    ITEM_COMMENT,
+    ITEM_KIND_COUNT,
+} ItemKind;
+
+static const char* const itemFlags[ITEM_KIND_COUNT] = {
+    "--literals", "--identifiers", "--blocks", "--strings", "--comments",
+};
+
+typedef struct {
+    int weights[ITEM_KIND_COUNT];
+    int stringLength;
+    int maxDepth;
+    uint32_t random;
+} Mix;
+
+typedef struct {
+    char* data;
+    size_t count;
+    size_t capacity;
+} Buffer;
+
+// What the unit being generated has declared so far.
+typedef struct {
+    int constants;
+    int globals;
+    int locals[UINT8_COUNT];    // names of the locals in scope, innermost last
+    int localCount;
+    int nextLocal;
+} Unit;
+
+typedef struct {
+    const char* mode;
+    size_t sourceBytes;
+    int units;
+    uint64_t tokens;
+    uint64_t bytecodeBytes;
+    uint64_t elapsedNs;
+    size_t peakBytes;
+} Result;
+
+// The runtime's live and peak bytes, kept by the allocator below.
+typedef struct {
+    size_t live;
+    size_t peak;
+} HeapUse;
+
+static void usage() {
+    fprintf(stderr, "Usage: frontend_bench [--mode scan|compile|full] [--size MB] [--seed N]\n"
+                    "                      [--literals W] [--identifiers W] [--blocks W]\n"
+                    "                      [--strings W] [--comments W] [--string-length N]\n"
+                    "                      [--max-depth N] [-O0 | -O1 | -O2] [--json file | --emit]\n");
+    exit(INVALID_CMD_ARGUMENTS);
+}
+
+static void append(Buffer* buffer, const char* text, size_t length) {
+    if (buffer->count + length + 1 > buffer->capacity) {
+        while (buffer->count + length + 1 > buffer->capacity) {
+            buffer->capacity = buffer->capacity < 4096 ? 4096 : buffer->capacity * 2;
+        }
+        buffer->data = realloc(buffer->data, buffer->capacity);
+        if (buffer->data == NULL) {
+            fprintf(stderr, "Not enough memory to generate the source\n");
+            exit(SOURCE_FILE_READING_ERROR);
+        }
+    }
+    memcpy(buffer->data + buffer->count, text, length);
+    buffer->count += length;
+    buffer->data[buffer->count] = '\0';
+}
+
+static void appendf(Buffer* buffer, const char* format, ...) {
+    char text[128];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    append(buffer, text, (size_t)length);
+}
+
+static uint32_t next_random(Mix* mix) {
+    uint32_t x = mix->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    mix->random = x;
+    return x;
+}
+
+static ItemKind pick_item(Mix* mix) {
+    int total = 0;
+    for (int i = 0; i < ITEM_KIND_COUNT; i++) total += mix->weights[i];
+
+    int pick = (int)(next_random(mix) % (uint32_t)total);
+    for (int i = 0; i < ITEM_KIND_COUNT; i++) {
+        if (pick < mix->weights[i]) return (ItemKind)i;
+        pick -= mix->weights[i];
+    }
+    return ITEM_COMMENT;
+}
+
+static void indent(Buffer* out, int depth) {
+    for (int i = 0; i < depth; i++) append(out, "    ", 4);
+}
+
+static void number(Buffer* out, Mix* mix, Unit* unit) {
+    uint32_t value = next_random(mix);
+    if (value & 1) {
+        appendf(out, "%u", value % 10000);
+    } else {
+        appendf(out, "%u.%u", value % 1000, (value >> 10) % 100);
+    }
+    unit->constants++;
+}
+
+// Any variable in scope; only numbers are ever stored, so every operator on
+// them runs.
+static void operand(Buffer* out, Mix* mix, Unit* unit) {
+    uint32_t pick = next_random(mix);
+    if (unit->globals > 0 && (unit->localCount == 0 || pick % 8 == 0)) {
+        appendf(out, "g%u", (pick >> 3) % (uint32_t)unit->globals);
+        unit->constants++;
+    } else if (unit->localCount > 0) {
+        appendf(out, "l%d", unit->locals[(pick >> 3) % (uint32_t)unit->localCount]);
+    } else {
+        number(out, mix, unit);
+    }
+}
+
+static const char operators[] = "+-*";
+
+static void expression(Buffer* out, Mix* mix, Unit* unit, int operands) {
+    operand(out, mix, unit);
+    for (int i = 1; i < operands; i++) {
+        appendf(out, " %c ", operators[next_random(mix) % 3]);
+        operand(out, mix, unit);
+    }
+}
+
+static void declare(Buffer* out, Unit* unit, int depth, int blockLocals) {
+    if (depth == 0) {
+        appendf(out, "var g%d = ", unit->globals);
+        unit->constants++;
+    } else if (blockLocals < BLOCK_LOCALS) {
+        appendf(out, "var l%d = ", unit->nextLocal);
+    } else {
+        appendf(out, "l%d = ", unit->locals[unit->localCount - 1]);
+    }
+}
+
+// The variable is only in scope once its initializer is compiled.
+static int declared(Unit* unit, int depth, int blockLocals) {
+    if (depth == 0) {
+        unit->globals++;
+        return 0;
+    }
+    if (blockLocals < BLOCK_LOCALS) {
+        unit->locals[unit->localCount++] = unit->nextLocal++;
+        return 1;
+    }
+    return 0;
+}
+
+static bool unit_full(Unit* unit, Buffer* out, size_t unitStart) {
+    return unit->constants + STATEMENT_CONSTANTS > UNIT_CONSTANTS || out->count - unitStart >= UNIT_BYTES;
+}
+
+static void statements(Buffer* out, Mix* mix, Unit* unit, int depth, size_t unitStart);
+
+// Returns how many locals the statement declared in the current block.
+static int statement(Buffer* out, Mix* mix, Unit* unit, int depth, int blockLocals, size_t unitStart) {
+    ItemKind kind = pick_item(mix);
+    if (kind == ITEM_BLOCK && depth >= mix->maxDepth) kind = ITEM_IDENTIFIER;
+    if (kind == ITEM_IDENTIFIER && unit->localCount == 0 && unit->globals == 0) kind = ITEM_LITERAL;
+
+    indent(out, depth);
+    switch (kind) {
+        case ITEM_LITERAL:
+            declare(out, unit, depth, blockLocals);
+            number(out, mix, unit);
+            append(out, " * ", 3);
+            number(out, mix, unit);
+            append(out, ";\n", 2);
+            return declared(unit, depth, blockLocals);
+        case ITEM_IDENTIFIER:
+            declare(out, unit, depth, blockLocals);
+            expression(out, mix, unit, 3);
+            append(out, ";\n", 2);
+            return declared(unit, depth, blockLocals);
+        case ITEM_BLOCK:
+            append(out, "{\n", 2);
+            statements(out, mix, unit, depth + 1, unitStart);
+            indent(out, depth);
+            append(out, "}\n", 2);
+            return 0;
+        case ITEM_STRING:
+            append(out, "print \"", 7);
+            for (int i = 0; i < mix->stringLength; i++) {
+                uint32_t pick = next_random(mix) % 27;
+                char c = pick == 26 ? ' ' : (char)('a' + pick);
+                append(out, &c, 1);
+            }
+            append(out, "\";\n", 3);
+            unit->constants++;
+            return 0;
+        case ITEM_COMMENT:
+        default:
+            append(out, "// ", 3);
+            for (int i = 0; i < COMMENT_LENGTH; i++) {
+                uint32_t pick = next_random(mix) % 27;
+                char c = pick == 26 ? ' ' : (char)('a' + pick);
+                append(out, &c, 1);
+            }
+            append(out, "\n", 1);
+            return 0;
+    }
+}
+
+// A block's body: a few statements, or fewer once the unit is full.
+static void statements(Buffer* out, Mix* mix, Unit* unit, int depth, size_t unitStart) {
+    int enclosing = unit->localCount;
+    int blockLocals = 0;
+    int count = 2 + (int)(next_random(mix) % 7);
+    for (int i = 0; i < count && !unit_full(unit, out, unitStart); i++) {
+        blockLocals += statement(out, mix, unit, depth, blockLocals, unitStart);
+    }
+    unit->localCount = enclosing;
+}
+
+// Appends scripts to `out` until it holds `size` bytes, NUL-terminating each
+// one and recording where it starts.
+static size_t* generate(Buffer* out, Mix* mix, size_t size, int* unitCount) {
+    int capacity = 0;
+    size_t* starts = NULL;
+    *unitCount = 0;
+
+    while (out->count < size) {
+        if (*unitCount == capacity) {
+            capacity = capacity < 64 ? 64 : capacity * 2;
+            starts = realloc(starts, sizeof(size_t) * capacity);
+        }
+        size_t unitStart = out->count;
+        starts[(*unitCount)++] = unitStart;
+
+        Unit unit = {0};
+        while (!unit_full(&unit, out, unitStart)) statement(out, mix, &unit, 0, 0, unitStart);
+        // Keep the terminator, so each unit is its own C string.
+        out->count++;
+        append(out, "", 0);
+    }
+    return starts;
+}
+
+static uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static void grew(HeapUse* heap, size_t bytes) {
+    heap->live += bytes;
+    if (heap->live > heap->peak) heap->peak = heap->live;
+}
+
+static void* counted_alloc(void* user, size_t size) {
+    void* pointer = malloc(size);
+    if (pointer != NULL) grew(user, size);
+    return pointer;
+}
+
+static void* counted_realloc(void* user, void* pointer, size_t oldSize, size_t newSize) {
+    void* result = realloc(pointer, newSize);
+    if (result == NULL) return NULL;
+    HeapUse* heap = user;
+    if (newSize > oldSize) {
+        grew(heap, newSize - oldSize);
+    } else {
+        heap->live -= oldSize - newSize;
+    }
+    return result;
+}
+
+static void counted_free(void* user, void* pointer, size_t size) {
+    free(pointer);
+    ((HeapUse*)user)->live -= size;
+}
+
+static uint64_t scan_unit(const char* source) {
+    uint64_t tokens = 0;
+    init_scanner(source);
+    for (;;) {
+        Token token = scan_token();
+        if (token.type == TOKEN_ERROR) {
+            fprintf(stderr, "Scan error on line %d: %.*s\n", token.line, token.length, token.start);
+            exit(COMPILER_ERROR);
+        }
+        if (token.type == TOKEN_EOF) return tokens;
+        tokens++;
+    }
+}
+
+static Result measure(const char* mode, Buffer* source, const size_t* starts, int unitCount,
+                      HeapUse* heap) {
+    bool scanOnly = strcmp(mode, "scan") == 0;
+    bool execute = strcmp(mode, "full") == 0;
+    if (!scanOnly && !execute && strcmp(mode, "compile") != 0) usage();
+
+    Result result = {mode, 0, unitCount, 0, 0, 0, 0};
+    size_t baseline = heap->live;
+    heap->peak = baseline;
+    uint64_t start = now_ns();
+    for (int i = 0; i < unitCount; i++) {
+        const char* unit = source->data + starts[i];
+        result.sourceBytes += strlen(unit);
+
+        if (scanOnly) {
+            result.tokens += scan_unit(unit);
+            continue;
+        }
+
+        Program* program = compile_program(unit);
+        if (program == NULL) exit(COMPILER_ERROR);
+        result.bytecodeBytes += (uint64_t)program->chunk.count;
+
+        if (execute) {
+            bind_program(program);
+            reset_vm();
+            if (interpret_program(program) != INTERPRET_OK) exit(RUNTIME_ERROR);
+        }
+        release_program(program);
+    }
+    result.elapsedNs = now_ns() - start;
+    result.peakBytes = heap->peak - baseline;
+    return result;
+}
+
+static double per_second(uint64_t amount, uint64_t elapsedNs) {
+    return elapsedNs == 0 ? 0.0 : (double)amount * 1e9 / (double)elapsedNs;
+}
+
+static void write_json(const Result* result, FILE* out) {
+    fprintf(out, "{\"mode\": \"%s\", \"source_bytes\": %llu, \"units\": %d, \"elapsed_ns\": %llu, "
+                 "\"source_mb_per_second\": %.2f, \"tokens\": %llu, \"bytecode_bytes\": %llu, "
+                 "\"bytecode_bytes_per_second\": %.0f, \"peak_heap_bytes\": %zu}\n",
+            result->mode, (unsigned long long)result->sourceBytes, result->units,
+            (unsigned long long)result->elapsedNs,
+            per_second(result->sourceBytes, result->elapsedNs) / (1024.0 * 1024.0),
+            (unsigned long long)result->tokens, (unsigned long long)result->bytecodeBytes,
+            per_second(result->bytecodeBytes, result->elapsedNs), result->peakBytes);
+}
+
+static int int_argument(int argc, const char* argv[], int* i, int minimum) {
+    if (*i + 1 >= argc) usage();
+    int value = atoi(argv[++*i]);
+    if (value < minimum) usage();
+    return value;
+}
+
+int main(int argc, const char* argv[]) {
+    const char* mode = "compile";
+    const char* jsonPath = NULL;
+    bool emit = false;
+    int sizeMb = 16;
+    Mix mix = {{4, 4, 1, 1, 1}, 200, 8, 2463534242u};
+
+    for (int i = 1; i < argc; i++) {
+        bool matched = false;
+        for (int kind = 0; kind < ITEM_KIND_COUNT && !matched; kind++) {
+            if (strcmp(argv[i], itemFlags[kind]) == 0) {
+                mix.weights[kind] = int_argument(argc, argv, &i, 0);
+                matched = true;
+            }
+        }
+        if (matched) continue;
+
+        if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+            mode = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0) {
+            sizeMb = int_argument(argc, argv, &i, 1);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            mix.random = (uint32_t)int_argument(argc, argv, &i, 1);
+        } else if (strcmp(argv[i], "--string-length") == 0) {
+            mix.stringLength = int_argument(argc, argv, &i, 0);
+        } else if (strcmp(argv[i], "--max-depth") == 0) {
+            mix.maxDepth = int_argument(argc, argv, &i, 0);
+            if (mix.maxDepth > MAX_DEPTH_LIMIT) usage();
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (strcmp(argv[i], "--emit") == 0) {
+            emit = true;
+        } else if (strcmp(argv[i], "-O0") == 0) {
+            set_optimization_level(0);
+        } else if (strcmp(argv[i], "-O1") == 0) {
+            set_optimization_level(1);
+        } else if (strcmp(argv[i], "-O2") == 0) {
+            set_optimization_level(2);
+        } else {
+            usage();
+        }
+    }
+
+    int totalWeight = 0;
+    for (int kind = 0; kind < ITEM_KIND_COUNT; kind++) totalWeight += mix.weights[kind];
+    if (totalWeight == 0) usage();
+
+    Buffer source = {NULL, 0, 0};
+    int unitCount;
+    size_t* starts = generate(&source, &mix, (size_t)sizeMb * 1024 * 1024, &unitCount);
+
+    if (emit) {
+        for (int i = 0; i < unitCount; i++) printf("// unit %d\n%s", i, source.data + starts[i]);
+        free(starts);
+        free(source.data);
+        return 0;
+    }
+
+    FILE* discard = fopen("/dev/null", "w");
+    if (discard == NULL) {
+        fprintf(stderr, "Could not open /dev/null\n");
+        exit(SOURCE_FILE_READING_ERROR);
+    }
+
+    HeapUse heap = {0, 0};
+    vm.allocator = (AlloAllocator){counted_alloc, counted_realloc, counted_free, &heap};
+    init_vm();
+    set_output_file(discard);
+    Result result = measure(mode, &source, starts, unitCount, &heap);
+    free_vm();
+    fclose(discard);
+
+    fprintf(stderr, "%-8s %10s %8s %10s %12s %16s %12s\n", "mode", "source MB", "units", "ms", "source MB/s",
+            "bytecode MB/s", "peak heap KB");
+    fprintf(stderr, "%-8s %10.1f %8d %10.1f %12.2f %16.2f %12.1f\n", result.mode,
+            result.sourceBytes / (1024.0 * 1024.0), result.units, result.elapsedNs / 1e6,
+            per_second(result.sourceBytes, result.elapsedNs) / (1024.0 * 1024.0),
+            per_second(result.bytecodeBytes, result.elapsedNs) / (1024.0 * 1024.0),
+            result.peakBytes / 1024.0);
+
+    FILE* out = stdout;
+    if (jsonPath != NULL && (out = fopen(jsonPath, "w")) == NULL) {
+        fprintf(stderr, "Could not open file \"%s\" \n", jsonPath);
+        exit(SOURCE_FILE_READING_ERROR);
+    }
+    write_json(&result, out);
+    if (out != stdout) fclose(out);
+
+    free(starts);
+    free(source.data);
+    return 0;
+}
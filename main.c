@@ -1,15 +1,32 @@
+// setitimer() is POSIX, not C11.
+#define _DEFAULT_SOURCE
 
-
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/time.h>
+#define HAS_TIMEOUT
+#endif
+
 #include "Allo/chunk.h"
+#include "Allo/compiler.h"
+#include "Allo/debug.h"
+#include "Allo/emit_c.h"
+#include "Allo/object.h"
+#include "Allo/profile.h"
+#include "Allo/snapshot.h"
+#include "Allo/trace.h"
 #include "Allo/virtual_machine.h"
 
+#define RECORD_OUTPUT_BUFFER_SIZE (1 << 16)
+
 #define VALIDATE_FILE_OP(condition, message, path) if (!(condition)) { fprintf(stderr, message, path); exit(SOURCE_FILE_READING_ERROR); }
 
 char* read_file(const char* path) {
+    TRACE_BEGIN(PHASE_READ_FILE);
     FILE* file = fopen(path, "rb");
 
     VALIDATE_FILE_OP(file != NULL, "Could not open file \"%s\" \n", path);
@@ -27,9 +44,16 @@ char* read_file(const char* path) {
     buffer[bytesRead] = '\0';
 
     fclose(file);
+    TRACE_END(PHASE_READ_FILE);
     return buffer;
 }
 
+static void timed_out() {
+    flush_output(&vm.output);
+    fprintf(stderr, "Timed out.\n");
+    exit(TIMEOUT_ERROR);
+}
+
 void repl() {
     char line[1024];
     for (;;) {
@@ -40,7 +64,7 @@ void repl() {
             break;
         }
 
-        interpret_code(line);
+        if (interpret_code(line) == INTERPRET_TIMEOUT) timed_out();
     }
 }
 
@@ -51,22 +75,296 @@ void run_file(const char* path) {
 
     if (result == INTERPRET_RUNTIME_ERROR) exit(RUNTIME_ERROR);
     if (result == INTERPRET_COMPILE_ERROR) exit(COMPILER_ERROR);
+    if (result == INTERPRET_TIMEOUT) timed_out();
+}
+
+// Reads one newline-delimited record into a buffer that grows as needed.
+// Returns the record length without the newline, or -1 at the end of input.
+static int read_record(char** buffer, int* capacity) {
+    int length = 0;
+    int c;
+    while ((c = getchar()) != EOF && c != '\n') {
+        if (length + 1 >= *capacity) {
+            *capacity = *capacity < 256 ? 256 : *capacity * 2;
+            *buffer = (char*)realloc(*buffer, *capacity);
+            VALIDATE_FILE_OP(*buffer != NULL, "Not enough memory to read a record from %s\n", "stdin");
+        }
+        (*buffer)[length++] = (char)c;
+    }
+
+    if (c == EOF && length == 0) return -1;
+    if (length > 0 && (*buffer)[length - 1] == '\r') length--;
+    return length;
+}
+
+// Compiles the script once and runs it for every record on stdin, with the
+// record bound to the global `record`.
+void run_per_record(const char* path) {
+    char* source = read_file(path);
+    Program* program = compile_program(source);
+    free(source);
+
+    if (program == NULL) exit(COMPILER_ERROR);
+
+    configure_output(RECORD_OUTPUT_BUFFER_SIZE, FLUSH_WHEN_FULL);
+
+    bind_program(program);
+
+    char* record = NULL;
+    int capacity = 0;
+    int length;
+    bool hadError = false;
+    while ((length = read_record(&record, &capacity)) != -1) {
+        reset_vm();
+        define_global("record", OBJ_VAL(copy_string(length > 0 ? record : "", length)));
+
+        InterpretResult result = interpret_program(program);
+        if (result == INTERPRET_TIMEOUT) timed_out();
+        if (result != INTERPRET_OK) hadError = true;
+    }
+
+    free(record);
+    release_program(program);
+    flush_output(&vm.output);
+
+    if (hadError) exit(RUNTIME_ERROR);
+}
+
+// Prints the compiled bytecode without running it, followed by its register
+// translation under --registers. Instructions the compiler proved numeric show
+// up as the *_UNCHECKED forms.
+void dump_bytecode(const char* path) {
+    char* source = read_file(path);
+    Program* program = compile_program(source);
+    free(source);
+
+    if (program == NULL) exit(COMPILER_ERROR);
+
+    disassemble_chunk(&program->chunk, path);
+
+    if (vm.backend == BACKEND_REGISTER) {
+        RegisterChunk registers;
+        if (translate_to_registers(&program->chunk, &registers)) {
+            printf("\n");
+            disassemble_register_chunk(&registers, path);
+        }
+        free_register_chunk(&registers);
+    }
+    release_program(program);
+}
+
+// Prints the compiled script as C that links against the allo_runtime library.
+void emit_c_source(const char* path) {
+    char* source = read_file(path);
+    Program* program = compile_program(source);
+    free(source);
+
+    if (program == NULL) exit(COMPILER_ERROR);
+
+    bool emitted = emit_c(&program->chunk, path, stdout);
+    release_program(program);
+    if (!emitted) {
+        fprintf(stderr, "Could not translate \"%s\" to C.\n", path);
+        exit(COMPILER_ERROR);
+    }
+}
+
+// Filled in under --profile and reported at exit, so runs that stop on an
+// error are covered too.
+static Profile profile;
+static const char* profileName = "repl";
+static const char* foldedPath = NULL;
+
+static void report_profile() {
+    print_profile(&profile, stderr);
+    if (foldedPath != NULL && !write_folded_profile(&profile, profileName, foldedPath)) {
+        fprintf(stderr, "Could not write \"%s\" \n", foldedPath);
+    }
+    free_profile(&profile);
+}
+
+// Reported before the VM is freed so the live tables' probe lengths are
+// included, or at exit for runs that stop on an error.
+static bool metricsReported = false;
+
+static void report_metrics() {
+    if (metricsReported) return;
+    metricsReported = true;
+
+    Metrics metrics = get_metrics();
+    write_metrics_json(&metrics, stderr);
+}
+
+// Written after the VM is freed so teardown is included, or at exit for runs
+// that stop on an error.
+static const char* tracePath = NULL;
+
+static void report_trace() {
+    if (!TRACING()) return;
+    if (!write_trace(tracePath)) fprintf(stderr, "Could not write \"%s\" \n", tracePath);
+    stop_trace();
+}
+
+#ifdef HAS_TIMEOUT
+// The handler can't reach the thread's VM, so it goes through the address of
+// the VM's interrupt flag instead.
+static atomic_bool* timeoutFlag = NULL;
+
+static void on_timeout(int number) {
+    (void)number;
+    atomic_store(timeoutFlag, true);
+}
+#endif
+
+// Interrupts the script after `milliseconds`, stopping the run in progress
+// within DEADLINE_CHECK_INTERVAL instructions or one helper's check: under
+// --per-record, the current record's, whose buffered output is dropped.
+static bool start_timeout(long milliseconds) {
+#ifdef HAS_TIMEOUT
+    timeoutFlag = interrupt_flag();
+    signal(SIGALRM, on_timeout);
+    struct itimerval timer = {{0, 0}, {milliseconds / 1000, (milliseconds % 1000) * 1000}};
+    return setitimer(ITIMER_REAL, &timer, NULL) == 0;
+#else
+    (void)milliseconds;
+    return false;
+#endif
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: allo [-O0 | -O1 | -O2] [--registers | --jit]\n"
+                    "            [--profile | --profile-cycles] [--profile-folded=file] [--metrics]\n"
+                    "            [--trace-phases file] [--restore snapshot] [--timeout-ms n]\n"
+                    "            [--per-record | --dump-bytecode | --emit-c | --snapshot -o file] [path]\n");
+    exit(INVALID_CMD_ARGUMENTS);
 }
 
 int main(int argc, const char* argv[]) {
+    const char* path = NULL;
+    bool perRecord = false;
+    bool dumpBytecode = false;
+    bool emitC = false;
+    bool snapshot = false;
+    const char* snapshotPath = NULL;
+    const char* restorePath = NULL;
+    long timeoutMs = 0;
+    Backend backend = BACKEND_STACK;
+    bool profiling = false;
+    bool sampleCycles = false;
+    bool metrics = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--per-record") == 0) {
+            perRecord = true;
+        } else if (strcmp(argv[i], "--dump-bytecode") == 0) {
+            dumpBytecode = true;
+        } else if (strcmp(argv[i], "--emit-c") == 0) {
+            emitC = true;
+        } else if (strcmp(argv[i], "--snapshot") == 0) {
+            snapshot = true;
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 == argc) usage();
+            snapshotPath = argv[++i];
+        } else if (strcmp(argv[i], "--timeout-ms") == 0) {
+            if (i + 1 == argc) usage();
+            char* end;
+            timeoutMs = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || timeoutMs <= 0) usage();
+        } else if (strcmp(argv[i], "--restore") == 0) {
+            if (i + 1 == argc) usage();
+            restorePath = argv[++i];
+        } else if (strcmp(argv[i], "--registers") == 0) {
+            backend = BACKEND_REGISTER;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            backend = BACKEND_JIT;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profiling = true;
+        } else if (strcmp(argv[i], "--profile-cycles") == 0) {
+#ifndef ALLO_PROFILE_CYCLES
+            fprintf(stderr, "--profile-cycles needs a build configured with -DALLO_PROFILE_CYCLES=ON\n");
+            exit(INVALID_CMD_ARGUMENTS);
+#endif
+            profiling = true;
+            sampleCycles = true;
+        } else if (strncmp(argv[i], "--profile-folded=", 17) == 0) {
+            profiling = true;
+            foldedPath = argv[i] + 17;
+        } else if (strcmp(argv[i], "--metrics") == 0) {
+            metrics = true;
+        } else if (strcmp(argv[i], "--trace-phases") == 0) {
+            if (i + 1 == argc) usage();
+            tracePath = argv[++i];
+        } else if (strcmp(argv[i], "-O0") == 0) {
+            set_optimization_level(0);
+        } else if (strcmp(argv[i], "-O1") == 0) {
+            set_optimization_level(1);
+        } else if (strcmp(argv[i], "-O2") == 0) {
+            set_optimization_level(2);
+        } else if (path == NULL) {
+            path = argv[i];
+        } else {
+            usage();
+        }
+    }
+
+    if ((perRecord || dumpBytecode || emitC || snapshot) && path == NULL) usage();
+    if (perRecord + dumpBytecode + emitC + snapshot > 1) usage();
+    if (snapshot != (snapshotPath != NULL)) usage();
+    // Binding a program for --per-record starts it with no globals.
+    if (restorePath != NULL && (perRecord || dumpBytecode || emitC)) usage();
+    // Only the stack interpreter counts instructions.
+    if (profiling && backend != BACKEND_STACK) usage();
+
+    if (tracePath != NULL) {
+        start_trace(TRACE_DEFAULT_CAPACITY);
+        atexit(report_trace);
+    }
+
     init_vm();
+    select_backend(backend);
+    if (metrics) {
+        dump_metrics_on_signal();
+        atexit(report_metrics);
+    }
+    if (profiling) {
+        init_profile(&profile, sampleCycles);
+        if (path != NULL) profileName = path;
+        set_profile(&profile);
+        atexit(report_profile);
+    }
 
-    if (argc == 1) {
-        repl();
-    } else if (argc == 2) {
-        run_file(argv[1]);
-    } else {
-        fprintf(stderr, "Usage: allo [path]\n");
+    if (restorePath != NULL && !load_snapshot(restorePath)) {
+        fprintf(stderr, "Could not load snapshot \"%s\" \n", restorePath);
+        exit(SOURCE_FILE_READING_ERROR);
+    }
+
+    if (timeoutMs > 0 && !start_timeout(timeoutMs)) {
+        fprintf(stderr, "Could not start the --timeout-ms timer\n");
         exit(INVALID_CMD_ARGUMENTS);
     }
 
+    if (dumpBytecode) {
+        dump_bytecode(path);
+    } else if (emitC) {
+        emit_c_source(path);
+    } else if (perRecord) {
+        run_per_record(path);
+    } else if (snapshot) {
+        run_file(path);
+        if (!write_snapshot(snapshotPath)) {
+            fprintf(stderr, "Could not write \"%s\" \n", snapshotPath);
+            exit(SOURCE_FILE_READING_ERROR);
+        }
+    } else if (path != NULL) {
+        run_file(path);
+    } else {
+        repl();
+    }
+
 
+    if (metrics) report_metrics();
     free_vm();
+    report_trace();
 
     return 0;
 }